@@ -0,0 +1,753 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#include "simpl/analyzer.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "simpl/ast.hh"
+#include "simpl/built_in/control_flow.hh"
+#include "simpl/built_in/fn.hh"
+#include "simpl/function.hh"
+#include "simpl/interpreter.hh"
+#include "simpl/interpreter_util.hh"
+#include "simpl/overload.hh"
+#include "simpl/resolver.hh"
+#include "simpl/user_fn.hh"
+
+namespace simpl {
+
+namespace {
+
+class Literal : public Node {
+ public:
+  explicit Literal(Expr value) : value_(std::move(value)) {}
+  Expr Exec(Interpreter*) const override { return value_; }
+  const Expr* Peek(Interpreter*) const override { return &value_; }
+
+ private:
+  const Expr value_;
+};
+
+class LocalRef : public Node {
+ public:
+  LocalRef(size_t depth, size_t slot) : depth_(depth), slot_(slot) {}
+  Expr Exec(Interpreter* interpreter) const override {
+    return *Peek(interpreter);
+  }
+  const Expr* Peek(Interpreter* interpreter) const override {
+    return &interpreter->frame().Get(depth_, slot_);
+  }
+
+ private:
+  const size_t depth_;
+  const size_t slot_;
+};
+
+// A local variable whose frame is not known statically.
+class NameRef : public Node {
+ public:
+  explicit NameRef(const Atom* name) : name_(name) {}
+  Expr Exec(Interpreter* interpreter) const override {
+    return *Peek(interpreter);
+  }
+  const Expr* Peek(Interpreter* interpreter) const override {
+    return &interpreter->frame().Get(name_);
+  }
+
+ private:
+  const Atom* name_;
+};
+
+class GlobalRef : public Node {
+ public:
+  explicit GlobalRef(const Atom* name) : name_(name) {}
+  Expr Exec(Interpreter* interpreter) const override {
+    return *Peek(interpreter);
+  }
+  const Expr* Peek(Interpreter* interpreter) const override {
+    // Global bindings are only erased once the interpreter is destroyed, so
+    // the cell can be kept once found.
+    if (!cell_) {
+      cell_ = interpreter->globals()->Find(name_);
+      if (!cell_) {
+        throw std::runtime_error("Undefined variable '" + name_->name + "'");
+      }
+    }
+    return cell_;
+  }
+
+ private:
+  const Atom* name_;
+  mutable const Expr* cell_ = nullptr;
+};
+
+// A form left to the tree-walking interpreter.
+class Generic : public Node {
+ public:
+  Generic(Expr form, bool tail) : form_(std::move(form)), tail_(tail) {}
+  Expr Exec(Interpreter* interpreter) const override {
+    interpreter->set_tail_position(tail_ && holds<List>(form_));
+    return interpreter->Evaluate(form_);
+  }
+
+ private:
+  const Expr form_;
+  const bool tail_;
+};
+
+class Call : public Node {
+ public:
+  // `args` are the analyzed arguments, used when the callee turns out to be a
+  // strict function; if empty (and `analyzed` is false) the arguments are
+  // evaluated by the callee instead.
+  Call(node_ptr_t head, std::vector<node_ptr_t>&& args, bool analyzed,
+       ExprList&& forms, bool tail)
+      : head_(std::move(head)),
+        args_(std::move(args)),
+        analyzed_(analyzed),
+        forms_(std::move(forms)),
+        tail_(tail) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    return Invoke(interpreter, head_->Exec(interpreter));
+  }
+
+ protected:
+  Expr Invoke(Interpreter* interpreter, const Expr& callee) const {
+    if (auto* callable = std::get_if<callable_ptr_t>(&callee)) {
+      return Invoke(interpreter, *callable);
+    }
+    if (holds<Keyword>(callee)) {
+      if (forms_.size() != 1) {
+        throw std::runtime_error("Keyword expects 1 argument.");
+      }
+      if (!analyzed_) {
+        return std::get<Map>(interpreter->Evaluate(forms_.front())).at(callee);
+      }
+      if (const Expr* m = args_.front()->Peek(interpreter)) {
+        return std::get<Map>(*m).at(callee);
+      }
+      return std::get<Map>(args_.front()->Exec(interpreter)).at(callee);
+    }
+    throw std::runtime_error("Cannot apply a non-callable");
+  }
+
+  Expr Invoke(Interpreter* interpreter, const callable_ptr_t& callable) const {
+    if (callable->kind() == Callable::Kind::kMacro) {
+      // Held on to, as running it may replace the cached one.
+      auto expansion = Expand(interpreter, callable);
+      return expansion->Exec(interpreter);
+    }
+    if (analyzed_ && callable->is_strict()) {
+      ExprList args;
+      for (const auto& arg : args_) {
+        args.push_back(arg->Exec(interpreter));
+      }
+      return interpreter->ApplyEvaluated(callable, std::move(args), tail_);
+    }
+    return interpreter->Apply(callable, ExprList(forms_), tail_);
+  }
+
+  // A version that changes whenever the macro the head refers to may have
+  // been replaced. The head of a plain call may be anything, so any global
+  // definition counts.
+  virtual uint64_t MacroVersion(Interpreter* interpreter) const {
+    return interpreter->globals()->version();
+  }
+
+ private:
+  // Returns the expansion of the call of `macro`, analyzed. The arguments of
+  // a macro are the forms at the call site, so the expansion is made once
+  // and kept for as long as the head refers to the same macro, at the same
+  // MacroVersion: the macro runs once per call site, not once per call (see
+  // docs/implementation/macros.md). The version rules out a new macro made
+  // at the address of a freed one.
+  std::shared_ptr<const Node> Expand(Interpreter* interpreter,
+                                     const callable_ptr_t& macro) const {
+    if (!expansion_ || macro_ != macro.get() ||
+        version_ != MacroVersion(interpreter)) {
+      auto expanded =
+          interpreter->Trampoline(macro->Call(interpreter, ExprList(forms_)));
+      expansion_ = Analyze(interpreter, expanded, tail_);
+      macro_ = macro.get();
+      version_ = MacroVersion(interpreter);
+    }
+    return expansion_;
+  }
+
+  const node_ptr_t head_;
+  const std::vector<node_ptr_t> args_;
+  const bool analyzed_;
+  const ExprList forms_;
+  const bool tail_;
+  mutable std::shared_ptr<const Node> expansion_;
+  mutable const Callable* macro_ = nullptr;
+  mutable uint64_t version_ = 0;
+};
+
+// A call whose head is a global. The callee is cached at the call site until
+// a global is (re)defined, which is rare once a program is loaded.
+class GlobalCall : public Call {
+ public:
+  GlobalCall(const Atom* name, std::vector<node_ptr_t>&& args, bool analyzed,
+             ExprList&& forms, bool tail)
+      : Call(std::make_unique<GlobalRef>(name), std::move(args), analyzed,
+             std::move(forms), tail),
+        name_(name) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    const auto& globals = *interpreter->globals();
+    if (version_ != globals.version()) {
+      callee_ = nullptr;
+      if (const Expr* cell = globals.Find(name_)) {
+        if (const auto* callable = std::get_if<callable_ptr_t>(cell)) {
+          callee_ = callable->get();
+        }
+      }
+      version_ = globals.version();
+    }
+    if (!callee_) {
+      return Call::Exec(interpreter);
+    }
+    // The call may redefine the global and so refill the cache: hold on to
+    // the callee until it returns.
+    callable_ptr_t callee(callee_);
+    return Invoke(interpreter, callee);
+  }
+
+ protected:
+  // Only redefining the global itself replaces its macro.
+  uint64_t MacroVersion(Interpreter* interpreter) const override {
+    return interpreter->globals()->version(name_);
+  }
+
+ private:
+  const Atom* const name_;
+  mutable uint64_t version_ = std::numeric_limits<uint64_t>::max();
+  // Not owned, as the callee may well be the function this call is in: the
+  // global holds on to it for as long as the version is unchanged.
+  mutable Callable* callee_ = nullptr;
+};
+
+// A special form recognized by the global its head was bound to at analysis
+// time. If that binding has changed since, the form is evaluated like any
+// other call instead.
+class SpecialForm : public Node {
+ protected:
+  SpecialForm(const Expr* cell, const List& form, bool tail)
+      : cell_(cell),
+        callable_(std::get<callable_ptr_t>(*cell).get()),
+        fallback_(std::make_unique<Generic>(form, tail)) {}
+
+  bool Rebound() const {
+    const auto* callable = std::get_if<callable_ptr_t>(cell_);
+    return !callable || callable->get() != callable_;
+  }
+
+  const Expr* const cell_;
+  const Callable* const callable_;
+  const node_ptr_t fallback_;
+};
+
+class If : public SpecialForm {
+ public:
+  If(const Expr* cell, const List& form, bool tail, node_ptr_t cond,
+     node_ptr_t then, node_ptr_t otherwise)
+      : SpecialForm(cell, form, tail),
+        cond_(std::move(cond)),
+        then_(std::move(then)),
+        otherwise_(std::move(otherwise)) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    if (Rebound()) return fallback_->Exec(interpreter);
+    return IsTruthy(cond_->Exec(interpreter)) ? then_->Exec(interpreter)
+                                              : otherwise_->Exec(interpreter);
+  }
+
+ private:
+  const node_ptr_t cond_;
+  const node_ptr_t then_;
+  const node_ptr_t otherwise_;
+};
+
+class Logic : public SpecialForm {
+ public:
+  Logic(const Expr* cell, const List& form, bool tail, bool is_and,
+        std::vector<node_ptr_t>&& args)
+      : SpecialForm(cell, form, tail), is_and_(is_and), args_(std::move(args)) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    if (Rebound()) return fallback_->Exec(interpreter);
+    Expr result{is_and_};
+    for (const auto& arg : args_) {
+      if (IsTruthy(result) != is_and_) break;
+      result = arg->Exec(interpreter);
+    }
+    return result;
+  }
+
+ private:
+  const bool is_and_;
+  const std::vector<node_ptr_t> args_;
+};
+
+class Do : public SpecialForm {
+ public:
+  Do(const Expr* cell, const List& form, bool tail, Body&& body)
+      : SpecialForm(cell, form, tail), body_(std::move(body)) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    if (Rebound()) return fallback_->Exec(interpreter);
+    return body_.Exec(interpreter);
+  }
+
+ private:
+  const Body body_;
+};
+
+class Let : public SpecialForm {
+ public:
+  Let(const Expr* cell, const List& form, bool tail,
+      std::vector<const Atom*>&& names, std::vector<node_ptr_t>&& values,
+      Body&& body)
+      : SpecialForm(cell, form, tail),
+        names_(std::move(names)),
+        values_(std::move(values)),
+        body_(std::move(body)) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    if (Rebound()) return fallback_->Exec(interpreter);
+    auto env = interpreter->NewFrame(interpreter->env(), names_.size());
+    for (size_t i = 0; i < names_.size(); ++i) {
+      env->Bind(names_[i], values_[i]->Exec(interpreter));
+    }
+    auto result = interpreter->Execute(body_, env);
+    interpreter->ReleaseFrame(std::move(env));
+    return result;
+  }
+
+ private:
+  const std::vector<const Atom*> names_;
+  const std::vector<node_ptr_t> values_;
+  const Body body_;
+};
+
+// Rebinds the slots of its frame in place on every `recur`, unless a closure
+// made in the last iteration holds on to the frame.
+class Loop : public SpecialForm {
+ public:
+  Loop(const Expr* cell, const List& form, bool tail,
+       std::vector<const Atom*>&& names, std::vector<node_ptr_t>&& values,
+       Body&& body)
+      : SpecialForm(cell, form, tail),
+        names_(std::move(names)),
+        values_(std::move(values)),
+        body_(std::move(body)),
+        tail_(tail) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    if (Rebound()) return fallback_->Exec(interpreter);
+    auto& recurred = interpreter->recur_values();
+    const auto base = recurred.size();
+    const auto arity = names_.size();
+    auto env = interpreter->NewFrame(interpreter->env(), arity);
+    for (size_t i = 0; i < arity; ++i) {
+      env->Bind(names_[i], values_[i]->Exec(interpreter));
+    }
+    for (;;) {
+      auto result = interpreter->Execute(body_, env);
+      if (recurred.size() == base) {
+        // A recur from code left to the interpreter.
+        auto* values = built_in::Recur::Values(result, arity);
+        if (!values) {
+          interpreter->ReleaseFrame(std::move(env));
+          // The body is analyzed as a tail, for its recurs.
+          return tail_ ? result : interpreter->Trampoline(std::move(result));
+        }
+        std::move(values->begin(), values->end(),
+                  std::back_inserter(recurred));
+      }
+      auto value = recurred.begin() + base;
+      if (env.use_count() == 1) {
+        for (size_t i = 0; i < arity; ++i) {
+          env->Rebind(i, std::move(*value++));
+        }
+      } else {
+        env = interpreter->NewFrame(interpreter->env(), arity);
+        for (const auto* name : names_) {
+          env->Bind(name, std::move(*value++));
+        }
+      }
+      recurred.resize(base);
+    }
+  }
+
+ private:
+  const std::vector<const Atom*> names_;
+  const std::vector<node_ptr_t> values_;
+  const Body body_;
+  const bool tail_;
+};
+
+// A recur in the tail position of a loop with as many names as there are
+// arguments. It leaves the values to the loop.
+class Recur : public SpecialForm {
+ public:
+  Recur(const Expr* cell, const List& form, std::vector<node_ptr_t>&& args)
+      : SpecialForm(cell, form, true), args_(std::move(args)) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    if (Rebound()) return fallback_->Exec(interpreter);
+    auto& recurred = interpreter->recur_values();
+    const auto base = recurred.size();
+    try {
+      for (const auto& arg : args_) {
+        recurred.push_back(arg->Exec(interpreter));
+      }
+    } catch (...) {
+      recurred.resize(base);
+      throw;
+    }
+    return Expr{nullptr};
+  }
+
+ private:
+  const std::vector<node_ptr_t> args_;
+};
+
+class Def : public SpecialForm {
+ public:
+  Def(const Expr* cell, const List& form, bool tail, const Atom* name,
+      node_ptr_t value)
+      : SpecialForm(cell, form, tail), name_(name), value_(std::move(value)) {}
+
+  Expr Exec(Interpreter* interpreter) const override {
+    if (Rebound()) return fallback_->Exec(interpreter);
+    interpreter->globals()->Define(name_, value_->Exec(interpreter));
+    return Expr{nullptr};
+  }
+
+ private:
+  const Atom* name_;
+  const node_ptr_t value_;
+};
+
+// Adds the symbols at the head of the lists in `expr`, at any depth, to
+// `heads`.
+void CollectHeads(const Expr& expr, std::vector<const Atom*>* heads) {
+  std::visit(Overload{[&](const List& l) {
+                        if (!l.empty()) {
+                          if (const auto* s = std::get_if<Symbol>(&l.front())) {
+                            heads->push_back(s->atom);
+                          }
+                        }
+                        for (const auto& e : l) CollectHeads(e, heads);
+                      },
+                      [&](const Vector& v) {
+                        for (const auto& e : v) CollectHeads(e, heads);
+                      },
+                      [&](const Map& m) {
+                        for (const auto& [k, v] : m) {
+                          CollectHeads(k, heads);
+                          CollectHeads(v, heads);
+                        }
+                      },
+                      [&](const Quoted& qt) { CollectHeads(qt.expr(), heads); },
+                      [](const auto&) {}},
+             expr);
+}
+
+// Function forms are analyzed once and the code shared by every function
+// they create. The analysis depends on what the heads of the calls in the
+// body are bound to (special forms, macros, functions), so it is redone when
+// one of those globals is (re)defined, and only then.
+class Fn : public SpecialForm {
+ public:
+  Fn(const Expr* cell, const List& form, bool tail, Vector params,
+     ExprList body)
+      : SpecialForm(cell, form, tail),
+        params_(std::move(params)),
+        body_(std::move(body)) {
+    for (const auto& form : body_) CollectHeads(form, &heads_);
+    std::sort(heads_.begin(), heads_.end());
+    heads_.erase(std::unique(heads_.begin(), heads_.end()), heads_.end());
+  }
+
+  Expr Exec(Interpreter* interpreter) const override {
+    if (Rebound()) return fallback_->Exec(interpreter);
+    const auto& globals = *interpreter->globals();
+    if (version_ != globals.version()) {
+      if (!definition_ || HeadsRebound(globals)) {
+        versions_.clear();
+        for (const auto* head : heads_) {
+          versions_.push_back(globals.version(head));
+        }
+        definition_ =
+            built_in::Fn::MakeDef(interpreter, params_, ExprList(body_));
+      }
+      version_ = globals.version();
+    }
+    return static_cast<const built_in::Fn*>(callable_)->Make(interpreter,
+                                                             definition_);
+  }
+
+ private:
+  bool HeadsRebound(const Interpreter::Environment& globals) const {
+    for (size_t i = 0; i < heads_.size(); ++i) {
+      if (globals.version(heads_[i]) != versions_[i]) return true;
+    }
+    return false;
+  }
+
+  const Vector params_;
+  const ExprList body_;
+  std::vector<const Atom*> heads_;
+  // The versions of the bindings of `heads_` the definition was made with.
+  mutable std::vector<uint64_t> versions_;
+  mutable fn_def_ptr_t definition_;
+  mutable uint64_t version_ = std::numeric_limits<uint64_t>::max();
+};
+
+class Analyzer {
+ public:
+  // `locals` are the names bound in frames of the environment the code will
+  // run in that the resolver has not seen.
+  Analyzer(Interpreter* interpreter, const lexical_addresses_t& addresses,
+           std::vector<const Atom*>&& locals)
+      : interpreter_(interpreter),
+        addresses_(addresses),
+        locals_(std::move(locals)) {}
+
+  node_ptr_t Analyze(const Expr& form, bool tail) {
+    return std::visit(
+        Overload{[&](const Symbol& s) { return AnalyzeSymbol(s); },
+                 [&](const List& l) { return AnalyzeList(l, tail); },
+                 [&](const Quoted& qt) -> node_ptr_t {
+                   if (qt.kind() == Quoted::Kind::kQuote) {
+                     return std::make_unique<Literal>(qt.expr());
+                   }
+                   return std::make_unique<Generic>(form, tail);
+                 },
+                 [&](const auto&) -> node_ptr_t {
+                   return std::make_unique<Literal>(form);
+                 }},
+        form);
+  }
+
+  template <typename It>
+  Body AnalyzeBody(It begin, It end, bool tail) {
+    std::vector<node_ptr_t> nodes;
+    for (auto it = begin; it != end; ++it) {
+      nodes.push_back(Analyze(*it, tail && std::next(it) == end));
+    }
+    return Body(std::move(nodes));
+  }
+
+ private:
+  bool IsLocal(const Symbol& symbol) const {
+    return addresses_.contains(&symbol) ||
+           std::find(locals_.begin(), locals_.end(), symbol.atom) !=
+               locals_.end();
+  }
+
+  node_ptr_t AnalyzeSymbol(const Symbol& symbol) {
+    if (auto it = addresses_.find(&symbol); it != addresses_.end()) {
+      if (it->second.depth == LexicalAddress::kByName) {
+        return std::make_unique<NameRef>(symbol.atom);
+      }
+      return std::make_unique<LocalRef>(it->second.depth, it->second.slot);
+    }
+    if (IsLocal(symbol)) {
+      return std::make_unique<NameRef>(symbol.atom);
+    }
+    return std::make_unique<GlobalRef>(symbol.atom);
+  }
+
+  std::vector<node_ptr_t> AnalyzeArgs(const List& list) {
+    std::vector<node_ptr_t> args;
+    for (auto it = std::next(list.begin()); it != list.end(); ++it) {
+      args.push_back(Analyze(*it, false));
+    }
+    return args;
+  }
+
+  node_ptr_t AnalyzeCall(const List& list, bool tail, bool strict) {
+    ExprList forms(std::next(list.begin()), list.end());
+    auto args = strict ? AnalyzeArgs(list) : std::vector<node_ptr_t>{};
+    const auto* head = std::get_if<Symbol>(&list.front());
+    if (head && !IsLocal(*head)) {
+      return std::make_unique<GlobalCall>(head->atom, std::move(args), strict,
+                                          std::move(forms), tail);
+    }
+    return std::make_unique<Call>(Analyze(list.front(), false),
+                                  std::move(args), strict, std::move(forms),
+                                  tail);
+  }
+
+  node_ptr_t AnalyzeList(const List& list, bool tail) {
+    if (list.empty()) {
+      return std::make_unique<Literal>(Expr{nullptr});
+    }
+    const auto* head = std::get_if<Symbol>(&list.front());
+    if (!head || IsLocal(*head)) {
+      return AnalyzeCall(list, tail, true);
+    }
+    const Expr* cell = interpreter_->globals()->Find(head->atom);
+    const auto* callable =
+        cell ? std::get_if<callable_ptr_t>(cell) : nullptr;
+    if (!callable) {
+      // Most likely a function that is defined later.
+      return AnalyzeCall(list, tail, true);
+    }
+    const Callable* c = callable->get();
+    switch (c->builtin()) {
+      case Callable::Builtin::kIf:
+        if (list.size() == 4) {
+          auto it = std::next(list.begin());
+          auto cond = Analyze(*it++, false);
+          auto then = Analyze(*it++, tail);
+          auto otherwise = Analyze(*it, tail);
+          return std::make_unique<If>(cell, list, tail, std::move(cond),
+                                      std::move(then), std::move(otherwise));
+        }
+        break;
+      case Callable::Builtin::kAnd:
+      case Callable::Builtin::kOr: {
+        // The last operand is in tail position: its value is returned as is.
+        std::vector<node_ptr_t> args;
+        for (auto it = std::next(list.begin()); it != list.end(); ++it) {
+          args.push_back(Analyze(*it, tail && std::next(it) == list.end()));
+        }
+        return std::make_unique<Logic>(
+            cell, list, tail, c->builtin() == Callable::Builtin::kAnd,
+            std::move(args));
+      }
+      case Callable::Builtin::kDo:
+        return std::make_unique<Do>(
+            cell, list, tail,
+            AnalyzeBody(std::next(list.begin()), list.end(), tail));
+      case Callable::Builtin::kLet:
+        if (auto node = AnalyzeLet(cell, list, tail)) return node;
+        break;
+      case Callable::Builtin::kLoop:
+        if (auto node = AnalyzeLoop(cell, list, tail)) return node;
+        break;
+      case Callable::Builtin::kRecur:
+        // Anywhere else a recur is an error, left to built_in::Recur.
+        if (tail && loop_arity_ && list.size() - 1 == *loop_arity_) {
+          return std::make_unique<Recur>(cell, list, AnalyzeArgs(list));
+        }
+        break;
+      case Callable::Builtin::kDef:
+        if (list.size() == 3) {
+          auto it = std::next(list.begin());
+          if (const auto* name = std::get_if<Symbol>(&*it)) {
+            return std::make_unique<Def>(cell, list, tail, name->atom,
+                                         Analyze(*++it, false));
+          }
+        }
+        break;
+      case Callable::Builtin::kFn:
+        if (list.size() >= 2) {
+          auto it = std::next(list.begin());
+          if (const auto* params = std::get_if<Vector>(&*it)) {
+            return std::make_unique<Fn>(cell, list, tail, *params,
+                                        ExprList(std::next(it), list.end()));
+          }
+        }
+        break;
+      default:
+        break;
+    }
+    return AnalyzeCall(list, tail, c->is_strict());
+  }
+
+  // Returns null if the let form is malformed, leaving the error to be
+  // reported when it is run.
+  node_ptr_t AnalyzeLet(const Expr* cell, const List& list, bool tail) {
+    std::vector<const Atom*> names;
+    std::vector<node_ptr_t> values;
+    if (!AnalyzeBindings(list, &names, &values)) return nullptr;
+    auto num_locals = locals_.size();
+    locals_.insert(locals_.end(), names.begin(), names.end());
+    auto body = AnalyzeBody(std::next(list.begin(), 2), list.end(), tail);
+    locals_.resize(num_locals);
+    return std::make_unique<Let>(cell, list, tail, std::move(names),
+                                 std::move(values), std::move(body));
+  }
+
+  // Same for a loop, whose body is analyzed as a tail for its recurs.
+  node_ptr_t AnalyzeLoop(const Expr* cell, const List& list, bool tail) {
+    std::vector<const Atom*> names;
+    std::vector<node_ptr_t> values;
+    if (!AnalyzeBindings(list, &names, &values)) return nullptr;
+    auto num_locals = locals_.size();
+    locals_.insert(locals_.end(), names.begin(), names.end());
+    auto enclosing = std::exchange(loop_arity_, names.size());
+    auto body = AnalyzeBody(std::next(list.begin(), 2), list.end(), true);
+    loop_arity_ = enclosing;
+    locals_.resize(num_locals);
+    return std::make_unique<Loop>(cell, list, tail, std::move(names),
+                                  std::move(values), std::move(body));
+  }
+
+  // Analyzes the binding vector of a let or a loop form, whose values are
+  // evaluated in the enclosing environment.
+  bool AnalyzeBindings(const List& list, std::vector<const Atom*>* names,
+                       std::vector<node_ptr_t>* values) {
+    if (list.size() < 2) return false;
+    const auto* bindings = std::get_if<Vector>(&*std::next(list.begin()));
+    if (!bindings || bindings->size() % 2 != 0) return false;
+    for (size_t i = 0; i < bindings->size(); i += 2) {
+      const auto* name = std::get_if<Symbol>(&(*bindings)[i]);
+      if (!name) return false;
+      names->push_back(name->atom);
+      values->push_back(Analyze((*bindings)[i + 1], false));
+    }
+    return true;
+  }
+
+  Interpreter* interpreter_;
+  const lexical_addresses_t& addresses_;
+  std::vector<const Atom*> locals_;
+  // The number of names of the innermost loop whose body is being analyzed.
+  std::optional<size_t> loop_arity_;
+};
+
+}  // namespace
+
+Expr Body::Exec(Interpreter* interpreter) const {
+  Expr result{nullptr};
+  for (const auto& node : nodes_) {
+    result = node->Exec(interpreter);
+  }
+  return result;
+}
+
+node_ptr_t Analyze(Interpreter* interpreter, const Expr& form, bool tail) {
+  std::vector<const Atom*> locals;
+  for (const auto* env = &interpreter->frame(); env->parent();
+       env = env->parent()) {
+    locals.insert(locals.end(), env->names().begin(), env->names().end());
+  }
+  static const lexical_addresses_t kNoAddresses;
+  return Analyzer(interpreter, kNoAddresses, std::move(locals))
+      .Analyze(form, tail);
+}
+
+Body AnalyzeBody(Interpreter* interpreter, const ExprList& body,
+                 const lexical_addresses_t& addresses) {
+  return Analyzer(interpreter, addresses, {})
+      .AnalyzeBody(body.begin(), body.end(), true);
+}
+
+}  // namespace simpl
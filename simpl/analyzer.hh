@@ -0,0 +1,56 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_ANALYZER_HH_
+#define SIMPL_ANALYZER_HH_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "simpl/ast.hh"
+#include "simpl/interpreter.hh"
+#include "simpl/resolver.hh"
+
+namespace simpl {
+
+// A form that has been analyzed into directly executable code: variable
+// references know where to find their value and special forms are recognized
+// once, instead of on every evaluation.
+class Node {
+ public:
+  virtual ~Node() = default;
+  // Evaluates the node in the interpreter's current environment.
+  virtual Expr Exec(Interpreter* interpreter) const = 0;
+  // Returns the value in place if the node refers to a stored one, such as a
+  // variable, so that callers that only read it need not copy it.
+  virtual const Expr* Peek(Interpreter*) const { return nullptr; }
+};
+
+using node_ptr_t = std::unique_ptr<const Node>;
+
+// An analyzed sequence of forms whose last one is in tail position, such as
+// a function body.
+class Body {
+ public:
+  Body() = default;
+  explicit Body(std::vector<node_ptr_t>&& nodes) : nodes_(std::move(nodes)) {}
+  Expr Exec(Interpreter* interpreter) const;
+
+ private:
+  std::vector<node_ptr_t> nodes_;
+};
+
+// Analyzes a top-level form to be run in the interpreter's current
+// environment, in tail position if `tail` is set, as for the expansion of a
+// macro call in tail position.
+node_ptr_t Analyze(Interpreter* interpreter, const Expr& form,
+                   bool tail = false);
+
+// Analyzes a function body given the lexical addresses ResolveLocals found
+// in it. Other symbols are taken to be globals.
+Body AnalyzeBody(Interpreter* interpreter, const ExprList& body,
+                 const lexical_addresses_t& addresses);
+
+}  // namespace simpl
+
+#endif  // SIMPL_ANALYZER_HH_
@@ -2,10 +2,14 @@
 
 #include "simpl/ast.hh"
 
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <ranges>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 
 #include "simpl/overload.hh"
@@ -14,39 +18,85 @@ namespace simpl {
 
 namespace rv = std::views;
 
-Quoted::Quoted(const Expr& expr, Kind kind)
-    : expr_(std::make_unique<Expr>(expr)), kind_(kind) {}
+const Atom* Intern(std::string_view name) {
+  static std::mutex mutex;
+  // Atoms live in a deque so that growing the table never moves them; the
+  // index is keyed by views into the Atoms' own names.
+  static std::deque<Atom> atoms;
+  static std::unordered_map<std::string_view, const Atom*> index;
+  std::lock_guard lock(mutex);
+  if (auto it = index.find(name); it != index.end()) {
+    return it->second;
+  }
+  const auto& atom = atoms.emplace_back(
+      std::string(name), std::hash<std::string_view>{}(name),
+      static_cast<uint32_t>(atoms.size()));
+  index.emplace(atom.name, &atom);
+  return &atom;
+}
 
-Quoted::Quoted(const Quoted& other)
-    : expr_(std::make_unique<Expr>(*other.expr_)), kind_(other.kind_) {}
+Quoted::Quoted(const Expr& expr, Kind kind) : data_(MakeRc<Data>(expr, kind)) {}
 
-Quoted::Quoted(Quoted&& other) noexcept
-    : expr_(std::move(other.expr_)), kind_(other.kind_) {}
+Quoted::Quoted(const Quoted& other) = default;
 
-Quoted& Quoted::operator=(const Quoted& other) {
-  *expr_ = *(other.expr_);
-  kind_ = other.kind_;
-  return *this;
+Quoted::Quoted(Quoted&& other) noexcept = default;
+
+Quoted::~Quoted() = default;
+
+Quoted& Quoted::operator=(const Quoted& other) = default;
+
+Quoted& Quoted::operator=(Quoted&& other) noexcept = default;
+
+std::size_t Quoted::hash() const {
+  static Hash hash;
+  if (!data_->hashed) {
+    data_->hash = hash(data_->expr) ^ std::hash<uint32_t>{}(0xf00dcafe) ^
+                  std::hash<int>{}(static_cast<int>(data_->kind));
+    data_->hashed = true;
+  }
+  return data_->hash;
+}
+
+bool Quoted::operator==(const Quoted& other) const {
+  return data_ == other.data_ || (data_->kind == other.data_->kind &&
+                                  data_->expr == other.data_->expr);
 }
 
-Quoted& Quoted::operator=(Quoted&& other) noexcept {
-  expr_ = std::move(other.expr_);
-  kind_ = other.kind_;
+TailCall::TailCall(callable_ptr_t callable, ExprList&& args)
+    : data_(std::make_unique<Data>(std::move(callable), std::move(args))) {}
+
+TailCall::TailCall(const TailCall& other)
+    : data_(std::make_unique<Data>(*other.data_)) {}
+
+TailCall::TailCall(TailCall&& other) noexcept = default;
+
+TailCall::~TailCall() = default;
+
+TailCall& TailCall::operator=(const TailCall& other) {
+  data_ = std::make_unique<Data>(*other.data_);
   return *this;
 }
 
+TailCall& TailCall::operator=(TailCall&& other) noexcept = default;
+
+bool TailCall::operator==(const TailCall& other) const {
+  return data_->callable == other.data_->callable &&
+         data_->args == other.data_->args;
+}
+
 std::ostream& operator<<(std::ostream& os, const Symbol& s) {
-  return os << s.name;
+  return os << s.name();
+}
+
+std::ostream& operator<<(std::ostream& os, const Keyword& kw) {
+  return os << ':' << kw.name();
 }
 
 std::ostream& operator<<(std::ostream& os, const List& l) {
   os << '(';
-  if (!l.empty()) {
-    for (const auto& e : rv::take(l, l.size() - 1)) {
-      os << e;
-      os << ' ';
-    }
-    os << l.back();
+  const char* separator = "";
+  for (const auto& e : l) {
+    os << std::exchange(separator, " ") << e;
   }
   return os << ')';
 }
@@ -88,13 +138,10 @@ struct ExprPrinter {
   std::ostream& os;
   void operator()(const Symbol& s) { os << s; }
   void operator()(std::nullptr_t) { os << "nil"; }
-  void operator()(const std::string& s) { os << "\"" << s << "\""; }
+  void operator()(const String& s) { os << "\"" << s << "\""; }
   void operator()(bool b) { os << (b ? "true" : "false"); }
   void operator()(const TailCall& tc) { os << tc; }
-  template <typename T>
-  void operator()(std::shared_ptr<T> ep) {
-    os << *ep;
-  }
+  void operator()(const callable_ptr_t& c) { os << *c; }
   template <typename T>
   void operator()(T b) {
     os << b;
@@ -113,41 +160,21 @@ std::size_t Hash::operator()(const Expr& expr) const {
       Overload{[](int_type i) { return std::hash<int_type>{}(i); },
                [](float_type f) { return std::hash<float_type>{}(f); },
                [](bool b) { return std::hash<bool>{}(b); },
-               [](const std::string& s) { return std::hash<std::string>{}(s); },
+               [](const String& s) { return std::hash<String>{}(s); },
                [](const Symbol& s) { return s.hash(); },
                [](const Keyword& kw) { return kw.hash(); },
                [](std::nullptr_t) { return std::hash<uint32_t>{}(0xdeadbeef); },
-               [](callable_ptr_t c) { return std::hash<callable_ptr_t>{}(c); },
-               [](const List& l) {
-                 std::size_t seed = 0;
-                 for (auto& e : l) {
-                   seed ^= hash(e) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-                 }
-                 return seed;
-               },
-               [](const Vector& v) {
-                 std::size_t seed = 0;
-                 for (auto& e : v) {
-                   seed ^= hash(e) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-                 }
-                 return seed;
+               [](const callable_ptr_t& c) {
+                 return std::hash<const Callable*>{}(c.get());
                },
+               [](const List& l) { return l.hash(hash); },
+               [](const Vector& v) { return v.hash(hash); },
                [](const Quoted& qt) { return qt.hash(); },
-               [](const Map& m) {
-                 std::size_t seed = 0;
-                 for (auto& [k, v] : m) {
-                   seed ^= hash(k) + hash(v) * 0x9e3779b9;
-                 }
-                 return seed;
-               },
+               [](const Map& m) { return m.hash(hash); },
                [](const TailCall&) -> std::size_t {
                  throw std::logic_error("TailCall cannot be hashed");
                }},
       expr);
 }
 
-bool Quoted::operator==(const Quoted& other) const {
-  return kind_ == other.kind_ && *expr_ == *other.expr_;
-}
-
 }  // namespace simpl
@@ -4,21 +4,28 @@
 #define SIMPL_AST_HH_
 
 #include <concepts>
+#include <cstdint>
 #include <list>
 #include <memory>
 #include <ostream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include "simpl/config.hh"
+#include "simpl/containers.hh"
+#include "simpl/rc.hh"
+#include "simpl/string.hh"
 
 namespace simpl {
 
 class Callable;
-using callable_ptr_t = std::shared_ptr<Callable>;
+// Callables count their references themselves (see callable.cc).
+void Retain(const Callable* callable);
+void Release(const Callable* callable);
+using callable_ptr_t = Rc<Callable>;
 class Expr;
 
 class Hash {
@@ -30,22 +37,39 @@ class ExprList : public std::list<Expr> {
   using std::list<Expr>::list;
 };
 
+// An interned symbol or keyword name. Every distinct spelling is stored once
+// in a process-wide table and never freed, so an Atom pointer is a stable
+// handle: two names are equal iff their Atoms are the same object.
+struct Atom {
+  const std::string name;
+  const std::size_t hash;
+  const uint32_t id;  // Dense, assigned in order of first use.
+};
+
+// Returns the Atom for `name`, adding it to the table on first use.
+const Atom* Intern(std::string_view name);
+
 struct Symbol {
-  std::string name;
-  std::size_t hash() const {
-    return std::hash<std::string>{}(name) ^ std::hash<uint32_t>{}(0xdeadbeef);
-  }
-  bool operator==(const Symbol& other) const = default;
+  explicit Symbol(std::string_view name) : atom(Intern(name)) {}
+  const std::string& name() const { return atom->name; }
+  uint32_t id() const { return atom->id; }
+  std::size_t hash() const { return atom->hash ^ 0xdeadbeef; }
+  bool operator==(const Symbol& other) const { return atom == other.atom; }
+
+  const Atom* atom;
 };
 
 struct Keyword {
-  std::string name;
-  std::size_t hash() const {
-    return std::hash<std::string>{}(name) ^ std::hash<uint32_t>{}(0xbeefdead);
-  }
-  bool operator==(const Keyword& other) const = default;
+  explicit Keyword(std::string_view name) : atom(Intern(name)) {}
+  const std::string& name() const { return atom->name; }
+  uint32_t id() const { return atom->id; }
+  std::size_t hash() const { return atom->hash ^ 0xbeefdead; }
+  bool operator==(const Keyword& other) const { return atom == other.atom; }
+
+  const Atom* atom;
 };
 
+// A quoted form. Copies share it, along with its cached hash.
 class Quoted {
  public:
   enum class Kind { kQuote, kSyntaxQuote, kUnquote, kSplice };
@@ -53,38 +77,51 @@ class Quoted {
   Quoted(const Quoted& other);
   Quoted(Quoted&& other) noexcept;
   explicit Quoted(const Expr& expr, Kind kind = Kind::kQuote);
-  Kind kind() const { return kind_; }
-  const Expr& expr() const { return *expr_; }
+  ~Quoted();
+  Kind kind() const;
+  const Expr& expr() const;
   Quoted& operator=(const Quoted& other);
   Quoted& operator=(Quoted&& other) noexcept;
-  std::size_t hash() const {
-    static Hash hash;
-    return hash(*expr_) ^ std::hash<uint32_t>{}(0xf00dcafe) ^
-           std::hash<int>{}(static_cast<int>(kind_));
-  }
+  std::size_t hash() const;
   bool operator==(const Quoted& other) const;
+  // Reports the shared form to `tracer`, as PersistentList::Trace does its
+  // cells.
+  template <typename Tracer>
+  void Trace(Tracer& tracer) const;
 
  private:
-  std::unique_ptr<Expr> expr_;
-  Kind kind_;
+  struct Data;
+  Rc<const Data> data_;
 };
 
 // List and ExprList should not be automatically convertible
-class List : public std::list<Expr> {
-  using std::list<Expr>::list;
-};
+using List = PersistentList<Expr>;
 
-using Vector = std::vector<Expr>;
+using Vector = PersistentVector<Expr>;
 
-using Map = std::unordered_map<Expr, Expr, Hash>;
+using Map = PersistentMap<Expr, Expr, Hash>;
 
-struct TailCall {
-  callable_ptr_t callable;
-  ExprList args;  // Already evaluated
-  bool operator==(const TailCall&) const = default;
+// A call left for the trampoline to make.
+class TailCall {
+ public:
+  TailCall(callable_ptr_t callable, ExprList&& args);
+  TailCall(const TailCall& other);
+  TailCall(TailCall&& other) noexcept;
+  ~TailCall();
+  TailCall& operator=(const TailCall& other);
+  TailCall& operator=(TailCall&& other) noexcept;
+  const callable_ptr_t& callable() const;
+  ExprList& args();  // Already evaluated
+  bool operator==(const TailCall& other) const;
+
+ private:
+  struct Data;
+  std::unique_ptr<Data> data_;
 };
 
-using ExprBase = std::variant<int_type, float_type, bool, std::string, Symbol,
+// Every alternative is at most a pointer in size: aggregates, strings and
+// callables are handles to shared objects, so that an Expr is 16 bytes.
+using ExprBase = std::variant<int_type, float_type, bool, String, Symbol,
                               std::nullptr_t, callable_ptr_t, List, Vector,
                               Quoted, Map, Keyword, TailCall>;
 
@@ -93,9 +130,47 @@ class Expr : public ExprBase {
   using ExprBase::ExprBase;
 };
 
+static_assert(sizeof(Expr) == 16);
+
+struct Quoted::Data : RefCounted<Data> {
+  Data(const Expr& e, Kind k) : expr(e), kind(k) {}
+
+  const Expr expr;
+  const Kind kind;
+  mutable std::size_t hash = 0;
+  mutable bool hashed = false;
+};
+
+inline Quoted::Kind Quoted::kind() const { return data_->kind; }
+inline const Expr& Quoted::expr() const { return data_->expr; }
+
+template <typename Tracer>
+void Quoted::Trace(Tracer& tracer) const {
+  tracer.VisitShared(data_.get(), data_->use_count(),
+                     [](const void* data, Tracer& tracer) {
+                       tracer.Visit(static_cast<const Data*>(data)->expr);
+                     });
+}
+
+struct TailCall::Data : Accounted {
+  Data(callable_ptr_t c, ExprList&& a)
+      : callable(std::move(c)), args(std::move(a)) {
+    static_assert(Accountable<Data>);
+  }
+
+  callable_ptr_t callable;
+  ExprList args;
+};
+
+inline const callable_ptr_t& TailCall::callable() const {
+  return data_->callable;
+}
+inline ExprList& TailCall::args() { return data_->args; }
+
 std::ostream& operator<<(std::ostream& os, const Expr& e);
 std::ostream& operator<<(std::ostream& os, const List& l);
 std::ostream& operator<<(std::ostream& os, const Symbol& s);
+std::ostream& operator<<(std::ostream& os, const Keyword& kw);
 std::ostream& operator<<(std::ostream& os, const Vector& vec);
 std::ostream& operator<<(std::ostream& os, const Quoted& qt);
 std::ostream& operator<<(std::ostream& os, const TailCall& tc);
@@ -4,8 +4,11 @@
 
 #include <gtest/gtest.h>
 
+#include <iterator>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 #include "simpl/lexer.hh"
 #include "simpl/parser.hh"
@@ -34,6 +37,8 @@ TEST(AST, VectorOutput) {
 
 TEST(AST, EmptyVectorOutput) { EXPECT_EQ(FormatExpr("[]"), "[]"); }
 
+TEST(AST, KeywordOutput) { EXPECT_EQ(FormatExpr(":foo"), ":foo"); }
+
 TEST(AST, QuoteOutput) { EXPECT_EQ(FormatExpr("'(+ 1 2)"), "'(+ 1 2)"); }
 
 TEST(AST, ListHashIsOrderDependent) {
@@ -43,10 +48,246 @@ TEST(AST, ListHashIsOrderDependent) {
   EXPECT_NE(hash(l123), hash(l321));
 }
 
+TEST(AST, ListHashDoesNotDependOnHowTheListWasBuilt) {
+  Hash hash;
+  List built;
+  built.push_front(Expr{int_type{3}});
+  EXPECT_NE(hash(Expr{built}), 0);  // Caches the hash of the tail.
+  built.push_front(Expr{int_type{2}});
+  built.push_front(Expr{int_type{1}});
+  Expr whole{List{Expr{int_type{1}}, Expr{int_type{2}}, Expr{int_type{3}}}};
+  EXPECT_EQ(hash(Expr{built}), hash(whole));
+  EXPECT_EQ(Expr{built}, whole);
+}
+
+TEST(AST, ChangedVectorIsRehashed) {
+  Hash hash;
+  Vector vec{Expr{int_type{1}}, Expr{int_type{2}}};
+  Vector copy = vec;
+  auto before = hash(Expr{vec});
+  copy.set(1, Expr{int_type{3}});
+  EXPECT_NE(hash(Expr{copy}), before);
+  EXPECT_EQ(hash(Expr{vec}), before);
+  EXPECT_NE(vec, copy);
+  copy.set(1, Expr{int_type{2}});
+  EXPECT_EQ(hash(Expr{copy}), before);
+  EXPECT_EQ(vec, copy);
+}
+
+TEST(AST, MapsKeyedByVectors) {
+  Map map;
+  for (int i = 0; i < 100; ++i) {
+    map.emplace(Expr{Vector{Expr{int_type{i}}, Expr{int_type{i + 1}}}},
+                Expr{int_type{i}});
+  }
+  Expr key{Vector{Expr{int_type{41}}, Expr{int_type{42}}}};
+  EXPECT_EQ(map.at(key), Expr{int_type{41}});
+  EXPECT_FALSE(map.contains(Expr{Vector{Expr{int_type{41}}}}));
+}
+
 TEST(AST, QuotedSymbolHashDiffersFromRawStringHash) {
   Quoted q{Expr{Symbol{"foo"}}};
   Quoted k{Expr{Keyword{"foo"}}};
   EXPECT_NE(q.hash(), k.hash());
 }
 
+TEST(AST, SymbolsWithTheSameNameShareAnAtom) {
+  std::string name = "interned";
+  Symbol a{name};
+  Symbol b{std::string("intern") + "ed"};
+  EXPECT_EQ(a.atom, b.atom);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.hash(), b.hash());
+  EXPECT_NE(a, Symbol{"other"});
+  EXPECT_NE(a.id(), Symbol{"other"}.id());
+}
+
+TEST(AST, SymbolsAndKeywordsShareNamesButNotEquality) {
+  Symbol s{"shared"};
+  Keyword kw{"shared"};
+  EXPECT_EQ(s.atom, kw.atom);
+  EXPECT_NE(Expr{s}, Expr{kw});
+}
+
+TEST(AST, CopiedVectorSharesStorageUntilModified) {
+  Vector a{Expr{int_type{1}}, Expr{int_type{2}}};
+  Vector b = a;
+  EXPECT_EQ(&std::as_const(a).front(), &std::as_const(b).front());
+  b.push_back(Expr{int_type{3}});
+  EXPECT_EQ(a.size(), 2);
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_NE(&std::as_const(a).front(), &std::as_const(b).front());
+}
+
+TEST(AST, VectorsAreIndexedAcrossTrieLevels) {
+  Vector vec;
+  for (int i = 0; i < 100000; ++i) {
+    vec.push_back(Expr{int_type{i}});
+  }
+  ASSERT_EQ(vec.size(), 100000);
+  for (int i : {0, 31, 32, 1023, 1024, 1055, 32768, 99999}) {
+    EXPECT_EQ(vec[i], Expr{int_type{i}});
+  }
+  int_type expected = 0;
+  for (const auto& e : vec) {
+    EXPECT_EQ(e, Expr{expected++});
+  }
+  EXPECT_THROW(vec.at(100000), std::out_of_range);
+}
+
+TEST(AST, ModifiedVectorCopyLeavesTheOriginal) {
+  Vector original;
+  for (int i = 0; i < 2000; ++i) {
+    original.push_back(Expr{int_type{i}});
+  }
+  Vector copy = original;
+  copy.set(5, Expr{int_type{-1}});
+  copy.set(1999, Expr{int_type{-1}});
+  copy.push_back(Expr{int_type{2000}});
+  EXPECT_EQ(original[5], Expr{int_type{5}});
+  EXPECT_EQ(original[1999], Expr{int_type{1999}});
+  EXPECT_EQ(original.size(), 2000);
+  EXPECT_EQ(copy[5], Expr{int_type{-1}});
+  EXPECT_EQ(copy[1999], Expr{int_type{-1}});
+  EXPECT_EQ(copy.back(), Expr{int_type{2000}});
+}
+
+TEST(AST, RestOfVectorSharesItsElements) {
+  Vector vec;
+  for (int i = 0; i < 100; ++i) {
+    vec.push_back(Expr{int_type{i}});
+  }
+  auto rest = vec.rest();
+  EXPECT_EQ(rest.size(), 99);
+  EXPECT_EQ(&rest.front(), &vec[1]);
+  rest.push_back(Expr{int_type{100}});
+  EXPECT_EQ(rest[99], Expr{int_type{100}});
+  EXPECT_EQ(vec.size(), 100);
+}
+
+TEST(AST, MapGrowsPastTheSmallRepresentation) {
+  Map map;
+  for (int i = 0; i < 5000; ++i) {
+    EXPECT_TRUE(map.emplace(Expr{int_type{i}}, Expr{int_type{i * 2}}));
+  }
+  EXPECT_FALSE(map.emplace(Expr{int_type{7}}, Expr{nullptr}));
+  ASSERT_EQ(map.size(), 5000);
+  for (int i = 0; i < 5000; ++i) {
+    EXPECT_EQ(map.at(Expr{int_type{i}}), Expr{int_type{i * 2}});
+  }
+  EXPECT_FALSE(map.contains(Expr{int_type{5000}}));
+  EXPECT_EQ(std::distance(map.begin(), map.end()), 5000);
+}
+
+TEST(AST, ModifiedMapCopyLeavesTheOriginal) {
+  Map original;
+  for (int i = 0; i < 100; ++i) {
+    original.emplace(Expr{int_type{i}}, Expr{int_type{i}});
+  }
+  Map copy = original;
+  copy.insert_or_assign(Expr{int_type{1}}, Expr{int_type{-1}});
+  for (int i = 50; i < 100; ++i) {
+    EXPECT_EQ(copy.erase(Expr{int_type{i}}), 1);
+  }
+  EXPECT_EQ(copy.erase(Expr{int_type{50}}), 0);
+  EXPECT_EQ(copy.size(), 50);
+  EXPECT_EQ(copy.at(Expr{int_type{1}}), Expr{int_type{-1}});
+  EXPECT_EQ(original.size(), 100);
+  EXPECT_EQ(original.at(Expr{int_type{1}}), Expr{int_type{1}});
+  EXPECT_EQ(original.at(Expr{int_type{99}}), Expr{int_type{99}});
+  EXPECT_NE(copy, original);
+}
+
+TEST(AST, MapsWithTheSameEntriesAreEqual) {
+  Map a;
+  Map b;
+  for (int i = 0; i < 100; ++i) {
+    a.emplace(Expr{int_type{i}}, Expr{int_type{i}});
+    b.emplace(Expr{int_type{99 - i}}, Expr{int_type{99 - i}});
+  }
+  EXPECT_EQ(a, b);
+}
+
+struct CollidingHash {
+  std::size_t operator()(int) const { return 42; }
+};
+
+TEST(AST, MapKeepsKeysWithEqualHashes) {
+  PersistentMap<int, int, CollidingHash> map;
+  for (int i = 0; i < 20; ++i) {
+    map.emplace(i, i);
+  }
+  EXPECT_EQ(map.size(), 20);
+  EXPECT_EQ(map.at(13), 13);
+  map.erase(13);
+  EXPECT_FALSE(map.contains(13));
+  EXPECT_EQ(map.at(19), 19);
+}
+
+TEST(AST, ListsShareTails) {
+  List tail{Expr{int_type{2}}, Expr{int_type{3}}};
+  List list = tail;
+  list.push_front(Expr{int_type{1}});
+  EXPECT_EQ(list.size(), 3);
+  EXPECT_EQ(tail.size(), 2);
+  EXPECT_EQ(&list.rest().front(), &tail.front());
+  EXPECT_EQ(list.rest(), tail);
+  list.pop_front();
+  EXPECT_EQ(&list.front(), &tail.front());
+}
+
+TEST(AST, DroppingALongListDoesNotRecurse) {
+  List list;
+  for (int i = 0; i < 1000000; ++i) {
+    list.push_front(Expr{int_type{i}});
+  }
+  EXPECT_EQ(list.size(), 1000000);
+  list.clear();
+  EXPECT_TRUE(list.empty());
+}
+
+TEST(AST, ShortAndLongStrings) {
+  String empty;
+  String short_string{"seven!!"};
+  String long_string{"more than seven bytes"};
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(short_string, "seven!!");
+  EXPECT_EQ(long_string.view(), "more than seven bytes");
+  String copy = long_string;
+  EXPECT_EQ(copy.view().data(), long_string.view().data());
+  EXPECT_EQ(copy, long_string);
+}
+
+TEST(AST, SubstringsShareTheirBuffer) {
+  String text{"the quick brown fox jumps over the lazy dog"};
+  String slice = text.substr(4, 15);
+  EXPECT_EQ(slice, "quick brown fox");
+  EXPECT_EQ(slice.view().data(), text.view().data() + 4);
+  String nested = slice.substr(6);
+  EXPECT_EQ(nested, "brown fox");
+  EXPECT_EQ(text.substr(4, 5), "quick");
+  text = String{};
+  EXPECT_EQ(nested, "brown fox");
+  EXPECT_TRUE(nested.is_slice());
+  String compact = nested.Compact();
+  EXPECT_FALSE(compact.is_slice());
+  EXPECT_EQ(compact, "brown fox");
+  EXPECT_EQ(compact.Compact().view().data(), compact.view().data());
+}
+
+TEST(AST, EqualStringsHashAlike) {
+  String whole{"0123456789"};
+  String slice = String{"xx0123456789yy"}.substr(2, 10);
+  EXPECT_EQ(whole, slice);
+  EXPECT_EQ(whole.hash(), slice.hash());
+  EXPECT_EQ(String{"abc"}.hash(), String{"xabc"}.substr(1).hash());
+}
+
+TEST(AST, CopiedStringsAreEqual) {
+  Expr a{String{"hello"}};
+  Expr b = a;
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(std::get<String>(b), "hello");
+}
+
 }  // namespace simpl
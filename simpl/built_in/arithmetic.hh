@@ -11,16 +11,25 @@ namespace simpl {
 namespace built_in {
 
 class Sum : public Function {
+ public:
+  Sum() : Function(Builtin::kSum) {}
+
  private:
   Expr FnCall(Interpreter* interpreter, args_type&& args) override;
 };
 
 class Subtract : public Function {
+ public:
+  Subtract() : Function(Builtin::kSubtract) {}
+
  private:
   Expr FnCall(Interpreter* interpreter, args_type&& args) override;
 };
 
 class Multiply : public Function {
+ public:
+  Multiply() : Function(Builtin::kMultiply) {}
+
  private:
   Expr FnCall(Interpreter* interpreter, args_type&& args) override;
 };
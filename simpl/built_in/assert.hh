@@ -18,7 +18,7 @@ class Assert : public Function {
  private:
   Expr FnCall(Interpreter*, args_type&& args) override {
     if (!IsTruthy(args.front())) {
-      auto reason = args.size() == 2 ? std::get<std::string>(args.back())
+      auto reason = args.size() == 2 ? std::get<String>(args.back()).str()
                                      : "Assertion failed.";
       throw std::runtime_error(reason);
     }
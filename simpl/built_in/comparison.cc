@@ -43,8 +43,8 @@ constexpr struct {
     return OrderingToInt(lhs <=> rhs);
   }
 
-  int operator()(std::string&& lhs, std::string&& rhs) const {
-    return lhs.compare(std::move(rhs));
+  int operator()(String&& lhs, String&& rhs) const {
+    return lhs.compare(rhs);
   }
 } compare;
 
@@ -13,26 +13,41 @@ namespace simpl {
 namespace built_in {
 
 class Equals : public Function {
+ public:
+  Equals() : Function(Builtin::kEquals) {}
+
  private:
   Expr FnCall(Interpreter*, args_type&& args) override;
 };
 
 class GreaterThan : public Function {
+ public:
+  GreaterThan() : Function(Builtin::kGreaterThan) {}
+
  private:
   Expr FnCall(Interpreter*, args_type&& args) override;
 };
 
 class GreaterThanOrEqualTo : public Function {
+ public:
+  GreaterThanOrEqualTo() : Function(Builtin::kGreaterThanOrEqualTo) {}
+
  private:
   Expr FnCall(Interpreter*, args_type&& args) override;
 };
 
 class LessThan : public Function {
+ public:
+  LessThan() : Function(Builtin::kLessThan) {}
+
  private:
   Expr FnCall(Interpreter*, args_type&& args) override;
 };
 
 class LessThanOrEqualTo : public Function {
+ public:
+  LessThanOrEqualTo() : Function(Builtin::kLessThanOrEqualTo) {}
+
  private:
   Expr FnCall(Interpreter*, args_type&& args) override;
 };
@@ -4,7 +4,10 @@
 
 #include <iterator>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "simpl/ast.hh"
 #include "simpl/interpreter.hh"
@@ -26,33 +29,103 @@ Expr If::Call(Interpreter* interpreter, args_type&& exprs) {
   auto then = i++;
   auto otherwise = i++;
 
-  interpreter->set_tail_position(was_tail);  // restore for chosen branch
+  // The chosen branch is in tail position if the `if` is.
   if (IsTruthy(cond)) {
-    return interpreter->Evaluate(*then);
+    return interpreter->EvaluateTail(*then, was_tail);
   } else {
-    return interpreter->Evaluate(*otherwise);
+    return interpreter->EvaluateTail(*otherwise, was_tail);
   }
 }
 
 Expr Let::Call(Interpreter* interpreter, args_type&& exprs) {
-  auto i = exprs.begin();
-  auto bindings = std::get<Vector>(*i++);
+  auto bindings = std::get<Vector>(std::move(exprs.front()));
+  exprs.pop_front();
   if (bindings.size() % 2 != 0) {
     throw std::runtime_error(
         "The number of expressions in the binding list must be even.");
   }
-  auto env = std::make_shared<Interpreter::Environment>(interpreter->env());
-  for (auto j = make_move_iterator(bindings.begin());
-       j != make_move_iterator(bindings.end());) {
-    auto name = std::get<Symbol>(*j++).name;
+  auto env = interpreter->NewFrame(interpreter->env(), bindings.size() / 2);
+  for (auto j = bindings.begin(); j != bindings.end();) {
+    const auto* name = std::get<Symbol>(*j++).atom;
     auto value = interpreter->Evaluate(*j++);
-    env->Bind(name, value);
+    env->Bind(name, std::move(value));
   }
-  return interpreter->EvaluateBody(ExprList(i, exprs.end()), env);
+  auto result = interpreter->EvaluateBody(exprs, env);
+  interpreter->ReleaseFrame(std::move(env));
+  return result;
 }
 
-Expr Do::FnCall(Interpreter*, args_type&& args) {
-  return std::move(args.back());
+Expr Loop::Call(Interpreter* interpreter, args_type&& exprs) {
+  auto bindings = std::get<Vector>(std::move(exprs.front()));
+  exprs.pop_front();
+  if (bindings.size() % 2 != 0) {
+    throw std::runtime_error(
+        "The number of expressions in the binding list must be even.");
+  }
+  const auto arity = bindings.size() / 2;
+  std::vector<const Atom*> names;
+  names.reserve(arity);
+  auto parent = interpreter->env();
+  auto env = interpreter->NewFrame(parent, arity);
+  for (auto j = bindings.begin(); j != bindings.end();) {
+    names.push_back(std::get<Symbol>(*j++).atom);
+    env->Bind(names.back(), interpreter->Evaluate(*j++));
+  }
+  for (;;) {
+    auto result = interpreter->EvaluateBody(exprs, env);
+    auto* values = Recur::Values(result, arity);
+    if (!values) {
+      interpreter->ReleaseFrame(std::move(env));
+      return result;
+    }
+    // A closure made in the last iteration keeps its own bindings.
+    if (env.use_count() == 1) {
+      env->Reset(parent, arity);
+    } else {
+      env = interpreter->NewFrame(parent, arity);
+    }
+    auto value = values->begin();
+    for (const auto* name : names) {
+      env->Bind(name, std::move(*value++));
+    }
+  }
+}
+
+Expr Recur::Call(Interpreter* interpreter, args_type&& exprs) {
+  bool was_tail = interpreter->tail_position();
+  interpreter->set_tail_position(false);
+  if (!was_tail) {
+    throw std::runtime_error("recur must be in the tail position of a loop");
+  }
+  ExprList values;
+  for (auto& expr : exprs) {
+    values.push_back(interpreter->Evaluate(std::move(expr)));
+  }
+  return TailCall{callable_ptr_t(this), std::move(values)};
+}
+
+ExprList* Recur::Values(Expr& result, size_t arity) {
+  auto* tc = std::get_if<TailCall>(&result);
+  if (!tc || tc->callable()->builtin() != Builtin::kRecur) {
+    return nullptr;
+  }
+  if (tc->args().size() != arity) {
+    throw std::runtime_error("recur expects " + std::to_string(arity) +
+                             " arguments, got " +
+                             std::to_string(tc->args().size()));
+  }
+  return &tc->args();
+}
+
+Expr Do::Call(Interpreter* interpreter, args_type&& exprs) {
+  bool was_tail = interpreter->tail_position();
+  interpreter->set_tail_position(false);
+  Expr result{nullptr};
+  for (auto it = exprs.begin(); it != exprs.end(); ++it) {
+    bool last = std::next(it) == exprs.end();
+    result = interpreter->EvaluateTail(std::move(*it), was_tail && last);
+  }
+  return result;
 }
 
 }  // namespace built_in
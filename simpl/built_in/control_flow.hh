@@ -5,7 +5,6 @@
 
 #include "simpl/ast.hh"
 #include "simpl/callable.hh"
-#include "simpl/function.hh"
 
 namespace simpl {
 
@@ -13,24 +12,53 @@ namespace built_in {
 
 class If : public Callable {
  public:
+  If() : Callable(Builtin::kIf) {}
   virtual ~If() = default;
   Expr Call(Interpreter* interpreter, args_type&& exprs) override;
+  bool forwards_tail_position() const override { return true; }
 };
 
-class Do : public Function {
+// Evaluates its arguments in order, the last one in the tail position of
+// the `do`, and returns the value of the last one (nil if there are none).
+class Do : public Callable {
  public:
+  Do() : Callable(Builtin::kDo) {}
   virtual ~Do() = default;
-
- private:
-  Expr FnCall(Interpreter*, args_type&& args) override;
+  Expr Call(Interpreter* interpreter, args_type&& exprs) override;
+  bool forwards_tail_position() const override { return true; }
 };
 
 class Let : public Callable {
  public:
+  Let() : Callable(Builtin::kLet) {}
   virtual ~Let() = default;
   Expr Call(Interpreter* interpreter, args_type&& exprs) override;
 };
 
+// Binds names like `let` and evaluates the body until it ends in something
+// other than a `recur`, which binds the names to new values instead.
+class Loop : public Callable {
+ public:
+  Loop() : Callable(Builtin::kLoop) {}
+  virtual ~Loop() = default;
+  Expr Call(Interpreter* interpreter, args_type&& exprs) override;
+};
+
+// Only valid in the tail position of a loop: returns a TailCall of itself
+// with the values for the loop to rebind. Anywhere else it throws, which is
+// also what happens when it escapes its loop and reaches a trampoline.
+class Recur : public Callable {
+ public:
+  Recur() : Callable(Builtin::kRecur) {}
+  virtual ~Recur() = default;
+  Expr Call(Interpreter* interpreter, args_type&& exprs) override;
+  bool forwards_tail_position() const override { return true; }
+
+  // Returns the values of `result` if it is the TailCall of a recur, checking
+  // that there are `arity` of them, or null for any other result.
+  static ExprList* Values(Expr& result, size_t arity);
+};
+
 }  // namespace built_in
 
 }  // namespace simpl
@@ -17,7 +17,7 @@ Expr Def::Call(Interpreter* interpreter, args_type&& exprs) {
   if (exprs.size() != 2) {
     throw std::runtime_error("`def` expects 2 arguments.");
   }
-  interpreter->env()->Define(std::get<Symbol>(exprs.front()).name,
+  interpreter->env()->Define(std::get<Symbol>(exprs.front()).atom,
                              interpreter->Evaluate(std::move(exprs.back())));
   return Expr{nullptr};
 }
@@ -26,7 +26,7 @@ Expr Defn::Call(Interpreter* interpreter, args_type&& exprs) {
   if (exprs.size() < 2) {
     throw std::runtime_error("`defn` expects at least 2 arguments.");
   }
-  auto name = std::get<Symbol>(exprs.front()).name;
+  const auto* name = std::get<Symbol>(exprs.front()).atom;
   List fn_body(++exprs.begin(), exprs.end());
   fn_body.push_front(Expr{Symbol{"fn"}});
   interpreter->env()->Define(name, interpreter->Evaluate(std::move(fn_body)));
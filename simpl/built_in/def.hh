@@ -10,12 +10,14 @@ namespace built_in {
 
 class Def : public Callable {
  public:
+  Def() : Callable(Builtin::kDef) {}
   virtual ~Def() = default;
   Expr Call(Interpreter* interpreter, args_type&& exprs) override;
 };
 
 class Defn : public Callable {
  public:
+  Defn() : Callable(Builtin::kDefn) {}
   virtual ~Defn() = default;
   Expr Call(Interpreter* interpreter, args_type&& exprs) override;
 };
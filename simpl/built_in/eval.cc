@@ -12,8 +12,10 @@ namespace simpl {
 namespace built_in {
 
 Expr Eval::FnCall(Interpreter* interpreter, args_type&& args) {
+  bool was_tail = interpreter->tail_position();
+  interpreter->set_tail_position(false);
   CheckArity("eval", args, 1);
-  return interpreter->Evaluate(std::move(args.front()));
+  return interpreter->EvaluateTail(std::move(args.front()), was_tail);
 }
 
 }  // namespace built_in
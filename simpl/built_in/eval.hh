@@ -9,6 +9,11 @@ namespace simpl {
 namespace built_in {
 
 class Eval : public Function {
+ public:
+  Eval() : Function(Builtin::kEval) {}
+  // The form is evaluated in the tail position of the call.
+  bool forwards_tail_position() const override { return true; }
+
  private:
   Expr FnCall(Interpreter*, args_type&& args) override;
 };
@@ -3,40 +3,62 @@
 #include "simpl/built_in/fn.hh"
 
 #include <algorithm>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <utility>
 
+#include "simpl/analyzer.hh"
 #include "simpl/ast.hh"
+#include "simpl/resolver.hh"
 #include "simpl/user_fn.hh"
 
 namespace simpl {
 namespace built_in {
 
 Expr Fn::Call(Interpreter* interpreter, args_type&& exprs) {
-  namespace rgs = std::ranges;
   if (exprs.size() < 1) {
     throw std::runtime_error("fn: missing arguments");
   }
   auto i = exprs.begin();
-  auto params = std::get<Vector>(*i++);
+  auto params = std::get<Vector>(std::move(*i++));
+  ExprList body;
+  std::move(i, exprs.end(), std::back_inserter(body));
+  return Make(interpreter, params, std::move(body));
+}
+
+Expr Fn::Make(Interpreter* interpreter, const Vector& params,
+              ExprList&& body) const {
+  return Make(interpreter, MakeDef(interpreter, params, std::move(body)));
+}
+
+Expr Fn::Make(Interpreter* interpreter, fn_def_ptr_t definition) const {
+  auto closure = MakeClosure(interpreter, definition->captures());
+  return std::make_unique<UserFn>(std::move(definition), std::move(closure),
+                                  lazy_);
+}
+
+fn_def_ptr_t Fn::MakeDef(Interpreter* interpreter, const Vector& params,
+                         ExprList&& body) {
+  namespace rgs = std::ranges;
   auto pos_params_end = rgs::find_if(params, [](const auto& param) {
-    return std::get<Symbol>(param).name == "&";
+    return std::get<Symbol>(param).name() == "&";
   });
   FnDef::param_list_t param_names;
   rgs::transform(
       params.begin(), pos_params_end, std::back_inserter(param_names),
-      [](const auto& param) { return std::get<Symbol>(param).name; });
-  std::string param_rest;
+      [](const auto& param) { return std::get<Symbol>(param).atom; });
+  const Atom* param_rest = nullptr;
   if (pos_params_end != params.end()) {
-    param_rest = std::get<Symbol>(*++pos_params_end).name;
+    param_rest = std::get<Symbol>(*++pos_params_end).atom;
   }
-  FnDef::body_t body;
-  std::move(i, exprs.end(), std::back_inserter(body));
-  return std::make_unique<UserFn>(
-      FnDef(FnDef::param_list_t(param_names.begin(), param_names.end()),
-            std::move(body), std::move(param_rest)),
-      interpreter->env(), lazy_);
+  auto captures = FindCaptures(interpreter, param_names, param_rest, body);
+  auto addresses =
+      ResolveLocals(interpreter, captures, param_names, param_rest, body);
+  auto code = AnalyzeBody(interpreter, body, addresses);
+  return std::make_shared<const FnDef>(std::move(param_names),
+                                       std::move(body), param_rest,
+                                       std::move(code), std::move(captures));
 }
 
 }  // namespace built_in
@@ -5,15 +5,27 @@
 
 #include "simpl/ast.hh"
 #include "simpl/callable.hh"
+#include "simpl/user_fn.hh"
 
 namespace simpl {
 namespace built_in {
 
 class Fn : public Callable {
  public:
-  explicit Fn(bool lazy = false) : lazy_(lazy) {}
+  explicit Fn(bool lazy = false) : Callable(Builtin::kFn), lazy_(lazy) {}
   virtual ~Fn() = default;
   Expr Call(Interpreter* interpreter, args_type&& exprs) override;
+  // Creates a function with the given parameter vector and body, closing
+  // over the interpreter's current environment.
+  Expr Make(Interpreter* interpreter, const Vector& params,
+            ExprList&& body) const;
+  // Same, for code built by MakeDef in an environment binding the same names.
+  Expr Make(Interpreter* interpreter, fn_def_ptr_t definition) const;
+  // Builds the code of a function with the given parameter vector and body,
+  // to be defined in the interpreter's current environment.
+  static fn_def_ptr_t MakeDef(Interpreter* interpreter, const Vector& params,
+                              ExprList&& body);
+  bool lazy() const { return lazy_; }
 
  private:
   bool lazy_;
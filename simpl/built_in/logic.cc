@@ -3,26 +3,40 @@
 #include "simpl/built_in/logic.hh"
 
 #include <iterator>
-#include <numeric>
 #include <utility>
 
 namespace simpl {
 namespace built_in {
 
+namespace {
+
+// Evaluates `exprs` until one is truthy (`until` true) or falsy, and returns
+// the last value. The last form is in the tail position of the call, since
+// its value is returned as it is.
+Expr EvaluateUntil(Interpreter* interpreter, Callable::args_type&& exprs,
+                   bool until, Expr&& result) {
+  bool was_tail = interpreter->tail_position();
+  interpreter->set_tail_position(false);
+  for (auto it = exprs.begin(); it != exprs.end(); ++it) {
+    if (std::next(it) == exprs.end()) {
+      return interpreter->EvaluateTail(std::move(*it), was_tail);
+    }
+    result = interpreter->Evaluate(std::move(*it));
+    if (IsTruthy(result) == until) {
+      break;
+    }
+  }
+  return std::move(result);
+}
+
+}  // namespace
+
 Expr Or::Call(Interpreter* interpreter, args_type&& exprs) {
-  return std::accumulate(
-      make_move_iterator(exprs.begin()), make_move_iterator(exprs.end()),
-      Expr{false}, [interpreter](Expr&& acc, Expr&& expr) -> Expr {
-        return IsTruthy(acc) ? acc : interpreter->Evaluate(std::move(expr));
-      });
+  return EvaluateUntil(interpreter, std::move(exprs), true, Expr{false});
 }
 
 Expr And::Call(Interpreter* interpreter, args_type&& exprs) {
-  return std::accumulate(
-      make_move_iterator(exprs.begin()), make_move_iterator(exprs.end()),
-      Expr{true}, [interpreter](Expr&& acc, Expr&& expr) -> Expr {
-        return IsTruthy(acc) ? interpreter->Evaluate(std::move(expr)) : acc;
-      });
+  return EvaluateUntil(interpreter, std::move(exprs), false, Expr{true});
 }
 
 }  // namespace built_in
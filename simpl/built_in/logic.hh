@@ -21,14 +21,18 @@ class Not : public Function {
 
 class Or : public Callable {
  public:
+  Or() : Callable(Builtin::kOr) {}
   virtual ~Or() = default;
   Expr Call(Interpreter* interpreter, args_type&& exprs) override;
+  bool forwards_tail_position() const override { return true; }
 };
 
 class And : public Callable {
  public:
+  And() : Callable(Builtin::kAnd) {}
   virtual ~And() = default;
   Expr Call(Interpreter* interpreter, args_type&& exprs) override;
+  bool forwards_tail_position() const override { return true; }
 };
 
 }  // namespace built_in
@@ -3,13 +3,16 @@
 #include "simpl/built_in/macro.hh"
 
 #include <algorithm>
+#include <iterator>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
 
 #include "simpl/ast.hh"
+#include "simpl/built_in/fn.hh"
 #include "simpl/interpreter.hh"
+#include "simpl/resolver.hh"
 #include "simpl/user_macro.hh"
 
 namespace simpl {
@@ -19,35 +22,17 @@ Expr Defmacro::Call(Interpreter* interpreter, args_type&& exprs) {
   if (exprs.size() < 3) {
     throw std::runtime_error("`defmacro` expects at least 3 arguments.");
   }
-  auto name = std::get<Symbol>(exprs.front()).name;
+  const auto* name = std::get<Symbol>(exprs.front()).atom;
 
-  // Reuse the same param-parsing logic as fn: build (fn [params] body...)
-  // and extract params + body manually.
-  namespace rgs = std::ranges;
-  auto it = exprs.begin();
-  ++it;  // skip name
-  auto params = std::get<Vector>(*it);
-  ++it;  // skip params
-
-  auto pos_params_end = rgs::find_if(params, [](const auto& param) {
-    return std::get<Symbol>(param).name == "&";
-  });
-  FnDef::param_list_t param_names;
-  rgs::transform(
-      params.begin(), pos_params_end, std::back_inserter(param_names),
-      [](const auto& param) { return std::get<Symbol>(param).name; });
-  std::string param_rest;
-  if (pos_params_end != params.end()) {
-    param_rest = std::get<Symbol>(*++pos_params_end).name;
-  }
-
-  FnDef::body_t body;
+  auto it = std::next(exprs.begin());
+  const auto& params = std::get<Vector>(*it++);
+  ExprList body;
   std::move(it, exprs.end(), std::back_inserter(body));
-
-  auto macro = std::make_shared<UserMacro>(
-      FnDef(std::move(param_names), std::move(body), std::move(param_rest)),
-      interpreter->env());
-  interpreter->env()->Define(name, Expr{callable_ptr_t{macro}});
+  auto definition = Fn::MakeDef(interpreter, params, std::move(body));
+  auto closure = MakeClosure(interpreter, definition->captures());
+  interpreter->env()->Define(
+      name, std::make_unique<UserMacro>(std::move(definition),
+                                        std::move(closure)));
   return Expr{nullptr};
 }
 
@@ -59,11 +44,10 @@ Expr Macroexpand::FnCall(Interpreter* interpreter, args_type&& args) {
   if (form.empty()) {
     return Expr{std::move(form)};
   }
-  auto first = std::get<Symbol>(form.front()).name;
+  const auto* first = std::get<Symbol>(form.front()).atom;
   auto resolved = interpreter->env()->Get(first);
   auto callable = std::get<callable_ptr_t>(resolved);
-  auto macro = std::dynamic_pointer_cast<UserMacro>(callable);
-  if (!macro) {
+  if (callable->kind() != Callable::Kind::kMacro) {
     throw std::runtime_error(
         "`macroexpand`: first element is not a macro.");
   }
@@ -71,7 +55,7 @@ Expr Macroexpand::FnCall(Interpreter* interpreter, args_type&& args) {
   ++it;
   ExprList macro_args;
   std::move(it, form.end(), std::back_inserter(macro_args));
-  return macro->Call(interpreter, std::move(macro_args));
+  return callable->Call(interpreter, std::move(macro_args));
 }
 
 }  // namespace built_in
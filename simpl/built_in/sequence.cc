@@ -3,7 +3,6 @@
 #include "simpl/built_in/sequence.hh"
 
 #include <concepts>
-#include <ranges>
 #include <stdexcept>
 #include <utility>
 #include <variant>
@@ -14,8 +13,6 @@
 namespace simpl {
 namespace built_in {
 
-namespace sv = std::views;
-
 namespace {
 
 template <typename T>
@@ -55,7 +52,10 @@ Expr Head::FnCall(Interpreter*, args_type&& args) {
           [](auto&&) -> Expr {
             throw std::runtime_error("head: invalid argument type");
           },
-          [](HasFront auto&& seq) { return Expr{std::move(seq.front())}; },
+          // Like the tail of an empty sequence, its head is not an error.
+          [](HasFront auto&& seq) {
+            return seq.empty() ? Expr{nullptr} : Expr{seq.front()};
+          },
       },
       std::move(args.front()));
 }
@@ -64,9 +64,7 @@ struct TailVisitor {
   template <typename T>
   Expr operator()(T&& seq) const {
     if constexpr (std::same_as<T, List> || std::same_as<T, Vector>) {
-      auto tail = sv::drop(seq, 1);
-      return T(make_move_iterator(tail.begin()),
-               make_move_iterator(tail.end()));
+      return seq.empty() ? Expr{T{}} : Expr{seq.rest()};
     } else {
       throw std::runtime_error("head: invalid argument type");
     }
@@ -8,6 +8,12 @@
 
 namespace simpl {
 
+void Retain(const Callable* callable) { ++callable->refs_; }
+
+void Release(const Callable* callable) {
+  if (--callable->refs_ == 0) delete callable;
+}
+
 std::ostream& operator<<(std::ostream& os, const Callable&) {
   return os << "<callable>";
 }
@@ -3,20 +3,89 @@
 #ifndef SIMPL_CALLABLE_HH_
 #define SIMPL_CALLABLE_HH_
 
+#include <cstdint>
 #include <list>
 #include <ostream>
 
 #include "simpl/ast.hh"
+#include "simpl/memory.hh"
 
 namespace simpl {
 
 class Interpreter;
+class Tracer;
 
-class Callable {
+class Callable : public Accounted {
  public:
+  // How calls are dispatched, so that the call path needs no RTTI.
+  enum class Kind : uint8_t {
+    kBuiltin,      // a Function taking evaluated arguments
+    kUserFn,       // a strict UserFn; tail calls to it are trampolined
+    kClosure,      // a strict vm::Closure, called inside the VM loop
+    kLazyFn,       // a Function taking unevaluated arguments
+    kMacro,        // a UserMacro; its result is evaluated again
+    kSpecialForm,  // any other Callable, taking unevaluated arguments
+  };
+
+  // Which built-in this is, for the analyzer, resolver and compiler, which
+  // treat these specially; kNone for any other callable.
+  enum class Builtin : uint8_t {
+    kNone,
+    kIf,
+    kDo,
+    kLet,
+    kLoop,
+    kRecur,
+    kFn,  // fn and lazy-fn (see built_in::Fn::lazy)
+    kDef,
+    kDefn,
+    kAnd,
+    kOr,
+    kEval,
+    kSum,
+    kSubtract,
+    kMultiply,
+    kEquals,
+    kLessThan,
+    kLessThanOrEqualTo,
+    kGreaterThan,
+    kGreaterThanOrEqualTo,
+  };
+
   using args_type = std::list<Expr>;
+  explicit Callable(Kind kind = Kind::kSpecialForm,
+                    Builtin builtin = Builtin::kNone)
+      : kind_(kind), builtin_(builtin) {}
+  // A built-in special form.
+  explicit Callable(Builtin builtin) : Callable(Kind::kSpecialForm, builtin) {}
+  Callable(const Callable&) = delete;
+  Callable& operator=(const Callable&) = delete;
   virtual ~Callable() {}
   virtual Expr Call(Interpreter*, args_type&& exprs) = 0;
+  Kind kind() const { return kind_; }
+  Builtin builtin() const { return builtin_; }
+  uint32_t use_count() const { return refs_; }
+  // Reports the environments and values this callable keeps alive, for the
+  // cycle collector (see Interpreter::Collect).
+  virtual void Trace(Tracer&) const {}
+  // Whether a call of this callable in tail position leaves a form of its own
+  // in tail position, as `if` does its branches. Such a callable reads and
+  // clears Interpreter::tail_position() on entry, before it evaluates
+  // anything.
+  virtual bool forwards_tail_position() const { return false; }
+  // Whether this is a Function that takes evaluated arguments.
+  bool is_strict() const {
+    return kind_ == Kind::kBuiltin || kind_ == Kind::kUserFn ||
+           kind_ == Kind::kClosure;
+  }
+
+ private:
+  friend void Retain(const Callable* callable);
+  friend void Release(const Callable* callable);
+
+  const Kind kind_;
+  const Builtin builtin_;
+  mutable uint32_t refs_ = 0;  // See callable_ptr_t.
 };
 
 std::ostream& operator<<(std::ostream& os, const Callable&);
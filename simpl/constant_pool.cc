@@ -0,0 +1,111 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#include "simpl/constant_pool.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <variant>
+
+#include "simpl/overload.hh"
+
+namespace simpl {
+
+namespace {
+
+// Whether no other key of a map can be equal to `key` without being the same.
+bool IsExactKey(const Expr& key) {
+  return std::holds_alternative<int_type>(key) ||
+         std::holds_alternative<bool>(key) ||
+         std::holds_alternative<std::nullptr_t>(key) ||
+         std::holds_alternative<String>(key) ||
+         std::holds_alternative<Keyword>(key);
+}
+
+}  // namespace
+
+const Expr& ConstantPool::Intern(Expr value) {
+  if (auto it = values_.find(value); it != values_.end()) {
+    return *it;
+  }
+  // A string literal is a slice of the source, which it would otherwise keep
+  // alive for as long as the constant is used.
+  if (auto* s = std::get_if<String>(&value)) {
+    *s = s->Compact();
+  }
+  return *values_.insert(std::move(value)).first;
+}
+
+bool ConstantPool::IsConstant(const Expr& expr) {
+  return IsData(expr, false);
+}
+
+// Lists and symbols are data only when quoted.
+bool ConstantPool::IsData(const Expr& expr, bool quoted) {
+  auto is_data = [quoted](const Expr& e) { return IsData(e, quoted); };
+  return std::visit(
+      Overload{[&](const Quoted& qt) {
+                 return qt.kind() == Quoted::Kind::kQuote &&
+                        IsData(qt.expr(), true);
+               },
+               [&](const List& l) {
+                 return quoted && std::all_of(l.begin(), l.end(), is_data);
+               },
+               [&](const Symbol&) { return quoted; },
+               [&](const Vector& v) {
+                 return std::all_of(v.begin(), v.end(), is_data);
+               },
+               [&](const Map& m) {
+                 // Keys must be exact, for Identical to match them up.
+                 return std::all_of(m.begin(), m.end(), [&](const auto& kv) {
+                   return IsExactKey(kv.first) && is_data(kv.second);
+                 });
+               },
+               [](const callable_ptr_t&) { return false; },
+               [](const TailCall&) { return false; },
+               [](const auto&) { return true; }},
+      expr);
+}
+
+bool ConstantPool::Identical::operator()(const Expr& lhs,
+                                         const Expr& rhs) const {
+  if (lhs.index() != rhs.index()) {
+    return false;
+  }
+  const Identical identical;
+  return std::visit(
+      Overload{
+          [&](float_type f) {
+            return std::bit_cast<uint64_t>(f) ==
+                   std::bit_cast<uint64_t>(std::get<float_type>(rhs));
+          },
+          [&](const List& l) {
+            const auto& other = std::get<List>(rhs);
+            return l.size() == other.size() &&
+                   std::equal(l.begin(), l.end(), other.begin(), identical);
+          },
+          [&](const Vector& v) {
+            const auto& other = std::get<Vector>(rhs);
+            return v.size() == other.size() &&
+                   std::equal(v.begin(), v.end(), other.begin(), identical);
+          },
+          [&](const Map& m) {
+            const auto& other = std::get<Map>(rhs);
+            return m.size() == other.size() &&
+                   std::all_of(m.begin(), m.end(), [&](const auto& kv) {
+                     const Expr* value = other.get(kv.first);
+                     return value && identical(kv.second, *value);
+                   });
+          },
+          [&](const Quoted& qt) {
+            const auto& other = std::get<Quoted>(rhs);
+            return qt.kind() == other.kind() &&
+                   identical(qt.expr(), other.expr());
+          },
+          [&](const auto&) { return lhs == rhs; }},
+      lhs);
+}
+
+}  // namespace simpl
@@ -0,0 +1,39 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_CONSTANT_POOL_HH_
+#define SIMPL_CONSTANT_POOL_HH_
+
+#include <unordered_set>
+
+#include "simpl/ast.hh"
+
+namespace simpl {
+
+// The literal data of a compilation unit: quoted forms, strings, and vectors
+// and maps of constants. Equal literals are stored once, so each evaluates to
+// the same shared, immutable value wherever it appears. Strings are stored
+// compacted (see String::Compact).
+class ConstantPool {
+ public:
+  // Returns the pooled value identical to `value`, adding it if there is none.
+  const Expr& Intern(Expr value);
+
+  // Whether `expr` is data that evaluates to itself, and so can be pooled.
+  // Lists and symbols are code: the resolver tells their occurrences apart.
+  static bool IsConstant(const Expr& expr);
+
+ private:
+  static bool IsData(const Expr& expr, bool quoted);
+
+  // Equality that also tells apart the floats that compare equal (0.0 and
+  // -0.0), so that pooling never changes a value.
+  struct Identical {
+    bool operator()(const Expr& lhs, const Expr& rhs) const;
+  };
+
+  std::unordered_set<Expr, Hash, Identical> values_;
+};
+
+}  // namespace simpl
+
+#endif  // SIMPL_CONSTANT_POOL_HH_
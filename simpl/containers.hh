@@ -0,0 +1,885 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_CONTAINERS_HH_
+#define SIMPL_CONTAINERS_HH_
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "simpl/memory.hh"
+#include "simpl/rc.hh"
+
+namespace simpl {
+
+// A value of type T behind an Rc: copies share it, and it is copied only
+// when modified while shared. An empty Cow holds a default T without
+// allocating.
+template <typename T>
+class Cow {
+ public:
+  Cow() = default;
+  explicit Cow(T&& value) : box_(MakeRc<Box>(std::move(value))) {}
+  explicit Cow(const T& value) : box_(MakeRc<Box>(value)) {}
+
+  const T& get() const { return box_ ? box_->value : Empty(); }
+  T& mut() {
+    if (!box_) {
+      box_ = MakeRc<Box>();
+    } else if (box_->use_count() > 1) {
+      box_ = MakeRc<Box>(box_->value);
+    }
+    return box_->value;
+  }
+
+  // Reports the shared value to `tracer`, which then has it report what it
+  // refers to in turn (see PersistentList::Trace).
+  template <typename Tracer>
+  void Trace(Tracer& tracer) const {
+    if (box_) {
+      tracer.VisitShared(box_.get(), box_->use_count(),
+                         [](const void* box, Tracer& tracer) {
+                           static_cast<const Box*>(box)->value.Trace(tracer);
+                         });
+    }
+  }
+
+ private:
+  struct Box : RefCounted<Box> {
+    Box() = default;
+    explicit Box(T&& v) : value(std::move(v)) {}
+    explicit Box(const T& v) : value(v) {}
+    T value;
+  };
+
+  static const T& Empty() {
+    static const T empty;
+    return empty;
+  }
+
+  Rc<Box> box_;
+};
+
+// Mixes the hash of the next element of a sequence into `seed`.
+inline std::size_t HashCombine(std::size_t seed, std::size_t hash) {
+  return seed ^ (hash + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+// The aggregate values of the language are pointer-sized handles to shared
+// containers, so that an Expr stays small and copying one never copies a
+// container. These are templates merely so that they can be declared before
+// the element type is complete.
+
+// An immutable singly linked list of cons cells. Lists share their tails, so
+// push_front and pop_front are O(1) and allocate at most one cell, and a
+// copy is a pointer copy. Each cell records the length of the list it
+// starts, so size() is O(1) too. There is no way to append; build a list
+// from a range, or backwards with push_front.
+template <typename T>
+class PersistentList {
+  struct Cell;
+
+ public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using reference = const T&;
+  using const_reference = const T&;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator() = default;
+    const T& operator*() const { return cell_->head; }
+    const T* operator->() const { return &cell_->head; }
+    const_iterator& operator++() {
+      cell_ = cell_->tail.get();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto it = *this;
+      ++*this;
+      return it;
+    }
+    bool operator==(const const_iterator&) const = default;
+
+   private:
+    friend class PersistentList;
+    explicit const_iterator(const Cell* cell) : cell_(cell) {}
+    const Cell* cell_ = nullptr;
+  };
+  using iterator = const_iterator;
+
+  PersistentList() = default;
+  PersistentList(std::initializer_list<T> init)
+      : PersistentList(init.begin(), init.end()) {}
+  template <std::input_iterator It>
+  PersistentList(It first, It last) {
+    if constexpr (std::bidirectional_iterator<It>) {
+      while (first != last) {
+        push_front(*--last);
+      }
+    } else {
+      std::vector<T> items(first, last);
+      for (auto it = items.rbegin(); it != items.rend(); ++it) {
+        push_front(std::move(*it));
+      }
+    }
+  }
+
+  const_iterator begin() const { return const_iterator(head_.get()); }
+  const_iterator end() const { return const_iterator(); }
+  size_type size() const { return head_ ? head_->size : 0; }
+  bool empty() const { return !head_; }
+  const T& front() const {
+    assert(!empty());
+    return head_->head;
+  }
+  // Linear in the size of the list.
+  const T& back() const {
+    assert(!empty());
+    const Cell* cell = head_.get();
+    while (cell->tail) {
+      cell = cell->tail.get();
+    }
+    return cell->head;
+  }
+  // The list without its first element, sharing its cells.
+  PersistentList rest() const {
+    assert(!empty());
+    PersistentList tail;
+    tail.head_ = head_->tail;
+    return tail;
+  }
+
+  void push_front(T value) {
+    head_ = MakeRc<Cell>(std::move(value), std::move(head_));
+  }
+  void pop_front() {
+    assert(!empty());
+    head_ = head_->tail;
+  }
+  void clear() { head_ = nullptr; }
+
+  // Reports the cells of the list to `tracer`, for a cycle collector: each
+  // cell with its reference count to tracer.VisitShared, along with a
+  // function that reports the element of the cell to tracer.Visit and the
+  // next cell the same way. Nothing recurses, so a long list can be traced
+  // with a work list.
+  template <typename Tracer>
+  void Trace(Tracer& tracer) const {
+    TraceCell(head_.get(), tracer);
+  }
+
+  // Returns the hash of the list, combining the hashes of its elements from
+  // the back. Every cell caches the hash of the list it starts, so a list
+  // is hashed once, and a list made by push_front hashes one element.
+  template <typename Hasher>
+  std::size_t hash(const Hasher& hasher) const {
+    if (!head_ || head_->hashed) {
+      return head_ ? head_->hash : 0;
+    }
+    std::vector<const Cell*> unhashed;
+    const Cell* cell = head_.get();
+    for (; cell && !cell->hashed; cell = cell->tail.get()) {
+      unhashed.push_back(cell);
+    }
+    std::size_t seed = cell ? cell->hash : 0;
+    for (auto it = unhashed.rbegin(); it != unhashed.rend(); ++it) {
+      seed = HashCombine(seed, hasher((*it)->head));
+      (*it)->hash = seed;
+      (*it)->hashed = true;
+    }
+    return seed;
+  }
+
+  // Lists compare equal as soon as they share a tail, and unequal as soon as
+  // their cached hashes differ.
+  bool operator==(const PersistentList& other) const {
+    if (size() != other.size()) {
+      return false;
+    }
+    for (auto a = head_.get(), b = other.head_.get(); a != b;
+         a = a->tail.get(), b = b->tail.get()) {
+      if (a->hashed && b->hashed && a->hash != b->hash) {
+        return false;
+      }
+      if (!(a->head == b->head)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  struct Cell : Accounted {
+    Cell(T&& h, Rc<Cell>&& t)
+        : head(std::move(h)),
+          tail(std::move(t)),
+          size(1 + (tail ? tail->size : 0)) {
+      static_assert(Accountable<Cell>);
+    }
+
+    // Releasing a cell releases its tail iteratively, so that dropping a
+    // long list does not recurse once per element.
+    friend void Retain(const Cell* cell) { ++cell->refs; }
+    friend void Release(const Cell* cell) {
+      while (cell && --cell->refs == 0) {
+        const Cell* next = const_cast<Cell*>(cell)->tail.release();
+        delete cell;
+        cell = next;
+      }
+    }
+
+    T head;
+    Rc<Cell> tail;
+    size_type size;
+    mutable std::size_t hash = 0;
+    mutable bool hashed = false;
+    mutable uint32_t refs = 0;
+  };
+
+  template <typename Tracer>
+  static void TraceCell(const Cell* cell, Tracer& tracer) {
+    if (cell) {
+      tracer.VisitShared(cell, cell->refs, [](const void* p, Tracer& tracer) {
+        const auto* cell = static_cast<const Cell*>(p);
+        tracer.Visit(cell->head);
+        TraceCell(cell->tail.get(), tracer);
+      });
+    }
+  }
+
+  Rc<Cell> head_;
+};
+
+// An immutable vector, stored as a 32-way trie of leaves of 32 elements
+// plus a tail buffer holding the last leaf, as in Clojure. Copies share the
+// whole trie: push_back and set copy only the path to the changed leaf, and
+// only the nodes of it that are shared. Indexing is O(log32 n). rest() is
+// O(1): it moves the start of the vector instead of its elements, so the
+// dropped prefix stays alive as long as the vector does.
+template <typename T>
+class PersistentVector {
+  struct Data;
+
+ public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using reference = const T&;
+  using const_reference = const T&;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator() = default;
+    const T& operator*() const { return leaf_[index_ & kMask]; }
+    const T* operator->() const { return &**this; }
+    const_iterator& operator++() {
+      if ((++index_ & kMask) == 0 && index_ != data_->end) {
+        leaf_ = data_->LeafFor(index_);
+      }
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto it = *this;
+      ++*this;
+      return it;
+    }
+    bool operator==(const const_iterator& other) const {
+      return index_ == other.index_;
+    }
+
+   private:
+    friend class PersistentVector;
+    const_iterator(const Data* data, size_type index)
+        : data_(data),
+          index_(index),
+          leaf_(index != data->end ? data->LeafFor(index) : nullptr) {}
+
+    const Data* data_ = nullptr;
+    size_type index_ = 0;
+    const T* leaf_ = nullptr;
+  };
+  using iterator = const_iterator;
+
+  PersistentVector() = default;
+  PersistentVector(std::initializer_list<T> init)
+      : PersistentVector(init.begin(), init.end()) {}
+  template <std::input_iterator It>
+  PersistentVector(It first, It last) {
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
+
+  const_iterator begin() const {
+    return const_iterator(&data_.get(), data_.get().start);
+  }
+  const_iterator end() const {
+    return const_iterator(&data_.get(), data_.get().end);
+  }
+  size_type size() const { return data_.get().end - data_.get().start; }
+  bool empty() const { return size() == 0; }
+  const T& operator[](size_type i) const {
+    const auto& data = data_.get();
+    return data.LeafFor(data.start + i)[(data.start + i) & kMask];
+  }
+  const T& at(size_type i) const {
+    if (i >= size()) {
+      throw std::out_of_range("vector index out of range");
+    }
+    return (*this)[i];
+  }
+  const T& front() const {
+    assert(!empty());
+    return (*this)[0];
+  }
+  const T& back() const {
+    assert(!empty());
+    return (*this)[size() - 1];
+  }
+  // The vector without its first element, sharing all of its storage.
+  PersistentVector rest() const {
+    PersistentVector tail = *this;
+    auto& data = tail.data_.mut();
+    ++data.start;
+    data.hashed = false;
+    return tail;
+  }
+
+  void push_back(T value) {
+    auto& data = data_.mut();
+    data.hashed = false;
+    if (data.end - data.TailOffset() == kWidth) {
+      PushTail(data);
+    }
+    data.tail.push_back(std::move(value));
+    ++data.end;
+  }
+  void set(size_type i, T value) {
+    auto& data = data_.mut();
+    data.hashed = false;
+    size_type index = data.start + i;
+    if (index >= data.TailOffset()) {
+      data.tail[index & kMask] = std::move(value);
+      return;
+    }
+    Node* node = Own(data.root);
+    for (unsigned level = data.shift; level > 0; level -= kBits) {
+      node = Own(node->children[(index >> level) & kMask]);
+    }
+    node->values[index & kMask] = std::move(value);
+  }
+  void clear() { data_ = {}; }
+
+  // Reports the storage of the vector to `tracer`, as PersistentList::Trace
+  // does its cells. Elements dropped by rest() are still reported, since
+  // they are kept alive.
+  template <typename Tracer>
+  void Trace(Tracer& tracer) const {
+    data_.Trace(tracer);
+  }
+
+  // Returns the hash of the elements in order, cached until the next change.
+  template <typename Hasher>
+  std::size_t hash(const Hasher& hasher) const {
+    const auto& data = data_.get();
+    if (!data.hashed) {
+      std::size_t seed = 0;
+      for (const auto& e : *this) {
+        seed = HashCombine(seed, hasher(e));
+      }
+      data.hash = seed;
+      data.hashed = true;
+    }
+    return data.hash;
+  }
+
+  bool operator==(const PersistentVector& other) const {
+    const auto& data = data_.get();
+    const auto& other_data = other.data_.get();
+    if (&data == &other_data) {
+      return true;
+    }
+    if (data.hashed && other_data.hashed && data.hash != other_data.hash) {
+      return false;
+    }
+    return size() == other.size() && std::equal(begin(), end(), other.begin());
+  }
+
+ private:
+  static constexpr unsigned kBits = 5;
+  static constexpr size_type kWidth = 1 << kBits;
+  static constexpr size_type kMask = kWidth - 1;
+
+  struct Node : RefCounted<Node> {
+    AccountedVector<Rc<Node>> children;  // Of an interior node.
+    AccountedVector<T> values;           // Of a leaf.
+  };
+
+  // Indexes into the trie are absolute: the vector holds [start, end).
+  struct Data {
+    // Elements before this index are in the trie, the rest in the tail.
+    size_type TailOffset() const {
+      return end < kWidth ? 0 : (end - 1) & ~kMask;
+    }
+
+    const T* LeafFor(size_type index) const {
+      if (index >= TailOffset()) {
+        return tail.data();
+      }
+      const Node* node = root.get();
+      for (unsigned level = shift; level > 0; level -= kBits) {
+        node = node->children[(index >> level) & kMask].get();
+      }
+      return node->values.data();
+    }
+
+    template <typename Tracer>
+    void Trace(Tracer& tracer) const {
+      TraceNode(root.get(), tracer);
+      for (const auto& value : tail) {
+        tracer.Visit(value);
+      }
+    }
+
+    size_type start = 0;
+    size_type end = 0;
+    unsigned shift = kBits;  // Of the level below the root.
+    Rc<Node> root;
+    AccountedVector<T> tail;
+    mutable std::size_t hash = 0;
+    mutable bool hashed = false;
+  };
+
+  template <typename Tracer>
+  static void TraceNode(const Node* node, Tracer& tracer) {
+    if (node) {
+      tracer.VisitShared(node, node->use_count(),
+                         [](const void* p, Tracer& tracer) {
+                           const auto* node = static_cast<const Node*>(p);
+                           for (const auto& child : node->children) {
+                             TraceNode(child.get(), tracer);
+                           }
+                           for (const auto& value : node->values) {
+                             tracer.Visit(value);
+                           }
+                         });
+    }
+  }
+
+  // Returns the node in `slot` after copying it if it is shared, so that it
+  // can be modified.
+  static Node* Own(Rc<Node>& slot) {
+    if (!slot) {
+      slot = MakeRc<Node>();
+    } else if (slot->use_count() > 1) {
+      slot = MakeRc<Node>(*slot);
+    }
+    return slot.get();
+  }
+
+  // Moves the full tail into the trie, adding a level if the trie is full.
+  static void PushTail(Data& data) {
+    auto leaf = MakeRc<Node>();
+    leaf->values = std::move(data.tail);
+    data.tail.clear();
+    data.tail.reserve(kWidth);
+    if (data.root && (data.end >> kBits) > (size_type{1} << data.shift)) {
+      auto root = MakeRc<Node>();
+      root->children.push_back(std::move(data.root));
+      data.root = std::move(root);
+      data.shift += kBits;
+    }
+    // The leaf covers [end - kWidth, end).
+    size_type index = data.end - 1;
+    Node* node = Own(data.root);
+    for (unsigned level = data.shift; level > kBits; level -= kBits) {
+      size_type child = (index >> level) & kMask;
+      if (child == node->children.size()) {
+        node->children.emplace_back();
+      }
+      node = Own(node->children[child]);
+    }
+    node->children.push_back(std::move(leaf));
+  }
+
+  Cow<Data> data_;
+};
+
+// An immutable hash map. A map of up to kSmallSize entries is a flat array
+// searched linearly, without hashing the keys. A larger one is a hash array
+// mapped trie (the CHAMP variant, with entries and subtries kept apart in
+// each node), so that an update copies only the shared nodes on the path to
+// the changed entry and lookups and updates are O(log32 n). Keys whose hashes
+// are equal in all their bits share a flat node at the bottom of the trie.
+template <typename K, typename V, typename H>
+class PersistentMap {
+  struct Node;
+
+ public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<K, V>;
+  using size_type = std::size_t;
+  using reference = const value_type&;
+  using const_reference = const value_type&;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = PersistentMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    const_iterator() = default;
+    const value_type& operator*() const {
+      return path_.back().node->entries[path_.back().index];
+    }
+    const value_type* operator->() const { return &**this; }
+    const_iterator& operator++() {
+      ++path_.back().index;
+      Settle();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto it = *this;
+      ++*this;
+      return it;
+    }
+    bool operator==(const const_iterator& other) const {
+      if (path_.empty() || other.path_.empty()) {
+        return path_.empty() == other.path_.empty();
+      }
+      return path_.back().node == other.path_.back().node &&
+             path_.back().index == other.path_.back().index;
+    }
+
+   private:
+    friend class PersistentMap;
+    explicit const_iterator(const Node* root) {
+      if (root) {
+        path_.push_back({root, 0});
+        Settle();
+      }
+    }
+
+    // Moves down to the next entry, in a node's entries and then in its
+    // subtries, or to the end.
+    void Settle() {
+      while (!path_.empty()) {
+        auto& [node, index] = path_.back();
+        if (index < node->entries.size()) {
+          return;
+        }
+        auto child = index++ - node->entries.size();
+        if (child < node->children.size()) {
+          path_.push_back({node->children[child].get(), 0});
+        } else {
+          path_.pop_back();
+        }
+      }
+    }
+
+    struct Position {
+      const Node* node;
+      size_type index;  // Into the entries, then the children, of the node.
+    };
+    std::vector<Position> path_;
+  };
+  using iterator = const_iterator;
+
+  PersistentMap() = default;
+  PersistentMap(std::initializer_list<value_type> init) {
+    for (const auto& [key, value] : init) {
+      emplace(key, value);
+    }
+  }
+
+  const_iterator begin() const {
+    return const_iterator(data_.get().root.get());
+  }
+  const_iterator end() const { return const_iterator(); }
+  size_type size() const { return data_.get().size; }
+  bool empty() const { return size() == 0; }
+  // Returns the value for `key`, or null if there is none.
+  const V* get(const K& key) const {
+    const Node* node = data_.get().root.get();
+    if (!node) {
+      return nullptr;
+    }
+    std::size_t hash = node->flat ? 0 : H{}(key);
+    for (unsigned shift = 0;; shift += kBits) {
+      if (node->flat) {
+        for (const auto& entry : node->entries) {
+          if (entry.first == key) {
+            return &entry.second;
+          }
+        }
+        return nullptr;
+      }
+      uint32_t bit = Bit(hash, shift);
+      if (node->datamap & bit) {
+        const auto& entry = node->entries[node->EntryIndex(bit)];
+        return entry.first == key ? &entry.second : nullptr;
+      }
+      if (!(node->nodemap & bit)) {
+        return nullptr;
+      }
+      node = node->children[node->ChildIndex(bit)].get();
+    }
+  }
+  size_type count(const K& key) const { return get(key) ? 1 : 0; }
+  bool contains(const K& key) const { return get(key) != nullptr; }
+  const V& at(const K& key) const {
+    if (const V* value = get(key)) {
+      return *value;
+    }
+    throw std::out_of_range("key not found in map");
+  }
+
+  // Adds the entry unless the map has `key` already. Returns whether it did.
+  bool emplace(K key, V value) {
+    return !contains(key) && Put(std::move(key), std::move(value));
+  }
+  void insert_or_assign(K key, V value) {
+    Put(std::move(key), std::move(value));
+  }
+  size_type erase(const K& key) {
+    if (!contains(key)) {
+      return 0;
+    }
+    auto& data = data_.mut();
+    data.hashed = false;
+    std::size_t hash = data.root->flat ? 0 : H{}(key);
+    Remove(data.root, key, hash, 0);
+    --data.size;
+    return 1;
+  }
+  void clear() { data_ = {}; }
+
+  // Reports the nodes of the trie to `tracer`, as PersistentList::Trace does
+  // its cells.
+  template <typename Tracer>
+  void Trace(Tracer& tracer) const {
+    data_.Trace(tracer);
+  }
+
+  // Returns a hash of the entries that does not depend on their order,
+  // cached until the next change.
+  template <typename Hasher>
+  std::size_t hash(const Hasher& hasher) const {
+    const auto& data = data_.get();
+    if (!data.hashed) {
+      std::size_t seed = 0;
+      for (const auto& [key, value] : *this) {
+        seed ^= hasher(key) + hasher(value) * 0x9e3779b9;
+      }
+      data.hash = seed;
+      data.hashed = true;
+    }
+    return data.hash;
+  }
+
+  bool operator==(const PersistentMap& other) const {
+    const auto& data = data_.get();
+    const auto& other_data = other.data_.get();
+    if (&data == &other_data) {
+      return true;
+    }
+    if (data.hashed && other_data.hashed && data.hash != other_data.hash) {
+      return false;
+    }
+    if (size() != other.size()) {
+      return false;
+    }
+    return std::all_of(begin(), end(), [&](const value_type& entry) {
+      const V* value = other.get(entry.first);
+      return value && *value == entry.second;
+    });
+  }
+
+ private:
+  static constexpr unsigned kBits = 5;
+  static constexpr std::size_t kSmallSize = 8;
+
+  struct Node : RefCounted<Node> {
+    size_type EntryIndex(uint32_t bit) const {
+      return std::popcount(datamap & (bit - 1));
+    }
+    size_type ChildIndex(uint32_t bit) const {
+      return std::popcount(nodemap & (bit - 1));
+    }
+
+    // A flat node is a small map at the root, or a set of keys with the
+    // same hash at the bottom of the trie; neither uses the bitmaps.
+    bool flat = false;
+    uint32_t datamap = 0;  // The hash fragments of the entries.
+    uint32_t nodemap = 0;  // The hash fragments of the children.
+    AccountedVector<value_type> entries;
+    AccountedVector<Rc<Node>> children;
+  };
+
+  struct Data {
+    template <typename Tracer>
+    void Trace(Tracer& tracer) const {
+      TraceNode(root.get(), tracer);
+    }
+
+    size_type size = 0;
+    Rc<Node> root;
+    mutable std::size_t hash = 0;
+    mutable bool hashed = false;
+  };
+
+  template <typename Tracer>
+  static void TraceNode(const Node* node, Tracer& tracer) {
+    if (node) {
+      tracer.VisitShared(node, node->use_count(),
+                         [](const void* p, Tracer& tracer) {
+                           const auto* node = static_cast<const Node*>(p);
+                           for (const auto& [key, value] : node->entries) {
+                             tracer.Visit(key);
+                             tracer.Visit(value);
+                           }
+                           for (const auto& child : node->children) {
+                             TraceNode(child.get(), tracer);
+                           }
+                         });
+    }
+  }
+
+  static uint32_t Bit(std::size_t hash, unsigned shift) {
+    return uint32_t{1} << ((hash >> shift) & ((1 << kBits) - 1));
+  }
+
+  // Returns the node in `slot` after copying it if it is shared, so that it
+  // can be modified.
+  static Node* Own(Rc<Node>& slot) {
+    if (slot->use_count() > 1) {
+      slot = MakeRc<Node>(*slot);
+    }
+    return slot.get();
+  }
+
+  // Inserts or assigns; returns whether the key is new.
+  bool Put(K key, V value) {
+    auto& data = data_.mut();
+    data.hashed = false;
+    if (!data.root) {
+      data.root = MakeRc<Node>();
+      data.root->flat = true;
+    }
+    if (data.root->flat && data.size == kSmallSize && !contains(key)) {
+      // Outgrown the flat representation.
+      auto small = std::move(data.root);
+      data.root = MakeRc<Node>();
+      for (const auto& [k, v] : small->entries) {
+        Insert(data.root, K(k), V(v), H{}(k), 0);
+      }
+    }
+    std::size_t hash = data.root->flat ? 0 : H{}(key);
+    bool added = Insert(data.root, std::move(key), std::move(value), hash, 0);
+    data.size += added;
+    return added;
+  }
+
+  static bool Insert(Rc<Node>& slot, K&& key, V&& value, std::size_t hash,
+                     unsigned shift) {
+    Node* node = Own(slot);
+    if (node->flat) {
+      for (auto& entry : node->entries) {
+        if (entry.first == key) {
+          entry.second = std::move(value);
+          return false;
+        }
+      }
+      node->entries.emplace_back(std::move(key), std::move(value));
+      return true;
+    }
+    uint32_t bit = Bit(hash, shift);
+    if (node->nodemap & bit) {
+      return Insert(node->children[node->ChildIndex(bit)], std::move(key),
+                    std::move(value), hash, shift + kBits);
+    }
+    auto i = node->EntryIndex(bit);
+    if (!(node->datamap & bit)) {
+      node->entries.emplace(node->entries.begin() + i, std::move(key),
+                            std::move(value));
+      node->datamap |= bit;
+      return true;
+    }
+    auto& entry = node->entries[i];
+    if (entry.first == key) {
+      entry.second = std::move(value);
+      return false;
+    }
+    // Two keys share this hash fragment: push both down into a new child.
+    auto child = MakeRc<Node>();
+    child->flat = shift + kBits >= 8 * sizeof(std::size_t);
+    std::size_t other_hash = H{}(entry.first);
+    Insert(child, std::move(entry.first), std::move(entry.second), other_hash,
+           shift + kBits);
+    Insert(child, std::move(key), std::move(value), hash, shift + kBits);
+    node->entries.erase(node->entries.begin() + i);
+    node->datamap &= ~bit;
+    node->children.insert(node->children.begin() + node->ChildIndex(bit),
+                          std::move(child));
+    node->nodemap |= bit;
+    return true;
+  }
+
+  // Removes `key`, which must be present.
+  static void Remove(Rc<Node>& slot, const K& key, std::size_t hash,
+                     unsigned shift) {
+    Node* node = Own(slot);
+    if (node->flat) {
+      std::erase_if(node->entries, [&](const value_type& entry) {
+        return entry.first == key;
+      });
+      return;
+    }
+    uint32_t bit = Bit(hash, shift);
+    if (node->datamap & bit) {
+      node->entries.erase(node->entries.begin() + node->EntryIndex(bit));
+      node->datamap &= ~bit;
+      return;
+    }
+    auto j = node->ChildIndex(bit);
+    Remove(node->children[j], key, hash, shift + kBits);
+    const Node& child = *node->children[j];
+    if (child.children.empty() && child.entries.size() == 1) {
+      // Keep the trie canonical: a lone entry moves up in place of its node.
+      auto entry = child.entries.front();
+      node->children.erase(node->children.begin() + j);
+      node->nodemap &= ~bit;
+      node->entries.insert(node->entries.begin() + node->EntryIndex(bit),
+                           std::move(entry));
+      node->datamap |= bit;
+    }
+  }
+
+  Cow<Data> data_;
+};
+
+}  // namespace simpl
+
+#endif  // SIMPL_CONTAINERS_HH_
@@ -12,7 +12,7 @@
 namespace simpl {
 
 Expr Function::Call(Interpreter* interpreter, args_type&& exprs) {
-  if (lazy_) {
+  if (is_lazy()) {
     return FnCall(interpreter, std::move(exprs));
   }
   std::transform(make_move_iterator(exprs.begin()),
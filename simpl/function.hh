@@ -12,9 +12,10 @@ namespace simpl {
 
 class Function : public Callable {
  public:
-  explicit Function(bool lazy = false) : lazy_(lazy) {}
+  explicit Function(bool lazy = false)
+      : Callable(lazy ? Kind::kLazyFn : Kind::kBuiltin) {}
   Expr Call(Interpreter*, args_type&& exprs) override;
-  bool is_lazy() const { return lazy_; }
+  bool is_lazy() const { return !is_strict(); }
   // Call FnCall directly with already-evaluated args (for TCO trampoline).
   Expr CallEvaluated(Interpreter* interpreter, args_type&& args) {
     return FnCall(interpreter, std::move(args));
@@ -22,7 +23,11 @@ class Function : public Callable {
 
  private:
   virtual Expr FnCall(Interpreter*, args_type&& args) = 0;
-  bool lazy_;
+
+ protected:
+  explicit Function(Kind kind) : Callable(kind) {}
+  // A strict built-in.
+  explicit Function(Builtin builtin) : Callable(Kind::kBuiltin, builtin) {}
 };
 
 }  // namespace simpl
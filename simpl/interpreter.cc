@@ -2,13 +2,18 @@
 
 #include "simpl/interpreter.hh"
 
+#include <algorithm>
+#include <chrono>
 #include <iterator>
 #include <memory>
-#include <numeric>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <variant>
+#include <vector>
 
+#include "simpl/analyzer.hh"
 #include "simpl/ast.hh"
 #include "simpl/built_in/arithmetic.hh"
 #include "simpl/built_in/assert.hh"
@@ -23,10 +28,9 @@
 #include "simpl/built_in/macro.hh"
 #include "simpl/built_in/sequence.hh"
 #include "simpl/config.hh"
+#include "simpl/function.hh"
 #include "simpl/interpreter_util.hh"
 #include "simpl/overload.hh"
-#include "simpl/user_fn.hh"
-#include "simpl/user_macro.hh"
 #include "simpl/util.hh"
 
 namespace simpl {
@@ -38,8 +42,8 @@ Expr ProcessSyntaxQuote(Interpreter* interpreter, Expr&& expr) {
   return std::visit(
       Overload{
           [&](List&& list) -> Expr {
-            List result;
-            for (auto& elem : list) {
+            ExprList result;
+            for (const auto& elem : list) {
               if (auto* qt = std::get_if<Quoted>(&elem)) {
                 if (qt->kind() == Quoted::Kind::kUnquote) {
                   result.push_back(
@@ -49,17 +53,16 @@ Expr ProcessSyntaxQuote(Interpreter* interpreter, Expr&& expr) {
                 if (qt->kind() == Quoted::Kind::kSplice) {
                   auto spliced =
                       interpreter->Evaluate(Expr{qt->expr()});
-                  auto& splice_list = std::get<List>(spliced);
-                  for (auto& e : splice_list) {
-                    result.push_back(std::move(e));
-                  }
+                  const auto& splice_list = std::get<List>(spliced);
+                  result.insert(result.end(), splice_list.begin(),
+                                splice_list.end());
                   continue;
                 }
               }
-              result.push_back(
-                  ProcessSyntaxQuote(interpreter, std::move(elem)));
+              result.push_back(ProcessSyntaxQuote(interpreter, Expr{elem}));
             }
-            return Expr{std::move(result)};
+            return Expr{List(std::make_move_iterator(result.begin()),
+                             std::make_move_iterator(result.end()))};
           },
           [&](Quoted&& qt) -> Expr {
             if (qt.kind() == Quoted::Kind::kUnquote) {
@@ -76,8 +79,158 @@ Expr ProcessSyntaxQuote(Interpreter* interpreter, Expr&& expr) {
       std::move(expr));
 }
 
+// The fewest environments made between two collections.
+constexpr size_t kMinCollection = 4096;
+
+// The graph of the environments the collector tracks and of the shared
+// objects reachable from them, in which it finds the objects that are
+// reachable from outside the graph.
+class HeapGraph : public Tracer {
+ public:
+  using Environment = Interpreter::Environment;
+
+  explicit HeapGraph(const std::vector<std::shared_ptr<Environment>>& envs) {
+    for (const auto& env : envs) {
+      envs_.try_emplace(env.get());
+    }
+    // First count the references within the graph...
+    for (const auto& env : envs) {
+      env->Trace(*this);
+    }
+    Drain();
+    // ...then mark from the objects that have others too. `envs` itself
+    // holds one reference to each environment.
+    marking_ = true;
+    for (const auto& env : envs) {
+      const auto refs = static_cast<size_t>(env.use_count()) - 1;
+      if (refs > envs_[env.get()].refs) {
+        Visit(env.get());
+      }
+    }
+    for (auto& [object, node] : objects_) {
+      if (node.use_count > node.refs && !node.live) {
+        node.live = true;
+        pending_objects_.push_back(object);
+      }
+    }
+    Drain();
+  }
+
+  bool IsLive(const Environment* env) const { return envs_.at(env).live; }
+  // The number of shared objects in the graph.
+  size_t num_objects() const { return objects_.size(); }
+
+  void Visit(const Environment* env) override {
+    auto it = envs_.find(env);
+    if (it == envs_.end()) {
+      return;
+    }
+    if (!marking_) {
+      ++it->second.refs;
+    } else if (!it->second.live) {
+      it->second.live = true;
+      pending_envs_.push_back(env);
+    }
+  }
+
+  void Visit(const Expr& value) override {
+    Tracer& tracer = *this;
+    std::visit(Overload{[&tracer](const callable_ptr_t& callable) {
+                          tracer.Visit(callable);
+                        },
+                        [&tracer](const auto& value) {
+                          if constexpr (requires { value.Trace(tracer); }) {
+                            value.Trace(tracer);
+                          }
+                        }},
+               value);
+  }
+
+  void Visit(const callable_ptr_t& callable) override {
+    VisitShared(callable.get(), callable->use_count(), &TraceCallable);
+  }
+
+  void VisitShared(const void* object, uint32_t use_count,
+                   TraceFn trace) override {
+    if (!marking_) {
+      auto [it, inserted] =
+          objects_.try_emplace(object, Object{use_count, trace});
+      ++it->second.refs;
+      if (inserted) {
+        pending_objects_.push_back(object);
+      }
+      return;
+    }
+    auto& node = objects_.at(object);
+    if (!node.live) {
+      node.live = true;
+      pending_objects_.push_back(object);
+    }
+  }
+
+ private:
+  struct Node {
+    size_t refs = 0;
+    bool live = false;
+  };
+
+  struct Object : Node {
+    Object(uint32_t use_count, TraceFn trace)
+        : use_count(use_count), trace(trace) {}
+    uint32_t use_count;
+    TraceFn trace;
+  };
+
+  static void TraceCallable(const void* callable, Tracer& tracer) {
+    static_cast<const Callable*>(callable)->Trace(tracer);
+  }
+
+  void Drain() {
+    while (!pending_envs_.empty() || !pending_objects_.empty()) {
+      if (!pending_envs_.empty()) {
+        const auto* env = pending_envs_.back();
+        pending_envs_.pop_back();
+        env->Trace(*this);
+      } else {
+        const auto* object = pending_objects_.back();
+        pending_objects_.pop_back();
+        objects_.at(object).trace(object, *this);
+      }
+    }
+  }
+
+  bool marking_ = false;
+  std::unordered_map<const Environment*, Node> envs_;
+  std::unordered_map<const void*, Object> objects_;
+  std::vector<const Environment*> pending_envs_;
+  std::vector<const void*> pending_objects_;
+};
+
 }  // namespace
 
+void Interpreter::Environment::Trace(Tracer& tracer) const {
+  if (parent_) {
+    tracer.Visit(parent_.get());
+  }
+  for (const auto& value : slots_) {
+    tracer.Visit(value);
+  }
+  for (const auto& cell : cells_) {
+    if (cell) {
+      tracer.Visit(cell->value);
+    }
+  }
+}
+
+void Interpreter::Environment::Clear() {
+  names_.clear();
+  slots_.clear();
+  cells_.clear();
+  // Callees cached by the version of the globals point into the cells.
+  ++version_;
+  parent_ = nullptr;
+}
+
 struct Interpreter::EvalVisitor {
   Interpreter* interpreter;
   Expr operator()(auto&& expr) { return std::forward<Expr>(expr); }
@@ -95,9 +248,9 @@ struct Interpreter::EvalVisitor {
     }
     return Expr{nullptr};
   }
-  Expr operator()(Symbol&& expr) {
-    return interpreter->env_->Get(std::move(expr.name));
-  }
+  Expr operator()(const Quoted& expr) { return (*this)(Quoted{expr}); }
+  Expr operator()(Symbol&& expr) { return Lookup(expr); }
+  Expr operator()(const Symbol& expr) { return Lookup(expr); }
   Expr operator()(List&& list) {
     if (list.empty()) {
       return Expr{nullptr};
@@ -110,79 +263,72 @@ struct Interpreter::EvalVisitor {
       if (list.size() != 2) {
         throw std::runtime_error("Keyword expects 1 argument.");
       }
-      auto m = interpreter->Evaluate(std::move(list.back()));
-      return std::get<Map>(m).at(result);
+      return LookUpKey(result, list.back());
     } else if (holds<callable_ptr_t>(result)) {
-      auto callable = std::get<callable_ptr_t>(result);
-
-      // Macro expansion: call with unevaluated args, then evaluate result.
-      auto macro = std::dynamic_pointer_cast<UserMacro>(callable);
-      if (macro) {
-        auto it = list.begin();
-        ++it;
-        ExprList args;
-        std::move(it, list.end(), std::back_inserter(args));
-        auto expanded = macro->Call(interpreter, std::move(args));
-        // The macro body may have emitted a TailCall (if its last expression
-        // was a tail-position user-fn call). Trampoline it to get the actual
-        // expanded form before re-evaluating it as code.
-        while (auto* tc = std::get_if<TailCall>(&expanded)) {
-          auto tc_fn = std::dynamic_pointer_cast<Function>(tc->callable);
-          if (tc_fn) {
-            expanded = tc_fn->CallEvaluated(interpreter, std::move(tc->args));
-          } else {
-            expanded = tc->callable->Call(interpreter, std::move(tc->args));
-          }
-        }
-        return interpreter->Evaluate(std::move(expanded));
-      }
-
       auto it = list.begin();
       ++it;
       ExprList args;
       std::move(it, list.end(), std::back_inserter(args));
+      return interpreter->Apply(std::get<callable_ptr_t>(result),
+                                std::move(args), in_tail);
+    } else {
+      throw std::runtime_error("Cannot apply a non-callable");
+    }
+  }
+  // Evaluates a call without copying the form: only the arguments of a strict
+  // function are needed, as values. Other callables take their arguments as
+  // forms, so those still get a copy.
+  Expr operator()(const List& list) {
+    if (list.empty()) {
+      return Expr{nullptr};
+    }
 
-      // Tail-position non-lazy UserFn: evaluate args now, return TailCall
-      // sentinel for the trampoline to iterate without growing the C++ stack.
-      auto fn = std::dynamic_pointer_cast<UserFn>(callable);
-      if (in_tail && fn && !fn->is_lazy()) {
-        ExprList evaluated;
-        for (auto& arg : args) {
-          evaluated.push_back(interpreter->Evaluate(std::move(arg)));
-        }
-        return TailCall{callable, std::move(evaluated)};
-      }
+    bool in_tail = std::exchange(interpreter->tail_position_, false);
 
-      // Only If reads tail_position_ to decide whether to restore it for its
-      // branches. Let uses EvaluateBody internally. All other callables
-      // (And, Or, *, +, eval, etc.) must NOT see tail_position_=true because
-      // they evaluate sub-expressions that are not in tail position.
-      if (in_tail && std::dynamic_pointer_cast<built_in::If>(callable)) {
-        interpreter->set_tail_position(true);
+    auto result = interpreter->Evaluate(list.front());
+    if (holds<Keyword>(result)) {
+      if (list.size() != 2) {
+        throw std::runtime_error("Keyword expects 1 argument.");
       }
-
-      auto call_result = callable->Call(interpreter, std::move(args));
-
-      // Non-tail context: run trampoline loop until a real value is returned.
-      if (!in_tail) {
-        while (auto* tc = std::get_if<TailCall>(&call_result)) {
-          auto tc_fn = std::dynamic_pointer_cast<Function>(tc->callable);
-          if (tc_fn) {
-            call_result =
-                tc_fn->CallEvaluated(interpreter, std::move(tc->args));
-          } else {
-            call_result = tc->callable->Call(interpreter, std::move(tc->args));
-          }
+      return LookUpKey(result, list.back());
+    } else if (const auto* callable = std::get_if<callable_ptr_t>(&result)) {
+      if ((*callable)->is_strict()) {
+        ExprList args;
+        for (auto it = std::next(list.begin()); it != list.end(); ++it) {
+          args.push_back(interpreter->Evaluate(*it));
         }
+        return interpreter->ApplyEvaluated(*callable, std::move(args),
+                                           in_tail);
       }
-      return call_result;
+      return interpreter->Apply(*callable,
+                                ExprList(std::next(list.begin()), list.end()),
+                                in_tail);
     } else {
       throw std::runtime_error("Cannot apply a non-callable");
     }
   }
+
+ private:
+  const Expr& Lookup(const Symbol& symbol) const {
+    return interpreter->env_->Get(symbol.atom);
+  }
+
+  // Looks `key` up in the map that `form` evaluates to, without copying the
+  // map when `form` is a variable.
+  Expr LookUpKey(const Expr& key, const Expr& form) {
+    if (const auto* symbol = std::get_if<Symbol>(&form)) {
+      return std::get<Map>(Lookup(*symbol)).at(key);
+    }
+    return std::get<Map>(interpreter->Evaluate(form)).at(key);
+  }
 };
 
-Interpreter::Interpreter() : env_(std::make_shared<Environment>()) {
+Interpreter::Interpreter()
+    : memory_(new MemoryAccount), next_collection_(kMinCollection) {
+  AccountScope scope(memory_.get());
+  globals_ = std::allocate_shared<Environment>(Allocator<Environment>());
+  env_ = globals_;
+  environments_.push_back(globals_);
   env_->Define("=", std::make_unique<built_in::Equals>());
   env_->Define(">", std::make_unique<built_in::GreaterThan>());
   env_->Define(">=", std::make_unique<built_in::GreaterThanOrEqualTo>());
@@ -207,6 +353,8 @@ Interpreter::Interpreter() : env_(std::make_shared<Environment>()) {
   env_->Define("defn", std::make_unique<built_in::Defn>());
   env_->Define("eval", std::make_unique<built_in::Eval>());
   env_->Define("let", std::make_unique<built_in::Let>());
+  env_->Define("loop", std::make_unique<built_in::Loop>());
+  env_->Define("recur", std::make_unique<built_in::Recur>());
   env_->Define("cons", std::make_unique<built_in::Cons>());
   env_->Define("head", std::make_unique<built_in::Head>());
   env_->Define("tail", std::make_unique<built_in::Tail>());
@@ -216,17 +364,199 @@ Interpreter::Interpreter() : env_(std::make_shared<Environment>()) {
   env_->Define("macroexpand", std::make_unique<built_in::Macroexpand>());
 }
 
+Interpreter::~Interpreter() {
+  env_ = nullptr;
+  globals_ = nullptr;
+  spare_frames_.clear();
+  Collect();
+}
+
 Expr Interpreter::Evaluate(Expr&& expr) {
   EvalVisitor visitor{this};
   return std::visit(visitor, std::move(expr));
 }
 
-Expr Interpreter::Evaluate(const ExprList& exprs,
-                           std::shared_ptr<Environment> env) {
-  return Evaluate(ExprList{exprs}, std::move(env));
+Expr Interpreter::Evaluate(const Expr& expr) {
+  EvalVisitor visitor{this};
+  return std::visit(visitor, expr);
+}
+
+Expr Interpreter::EvaluateTail(Expr&& form, bool tail) {
+  // Only a call consumes the flag, so it is never left set for another.
+  const auto* call = std::get_if<List>(&form);
+  tail_position_ = tail && call && !call->empty();
+  return Evaluate(std::move(form));
+}
+
+Expr Interpreter::Apply(const callable_ptr_t& callable, ExprList&& args,
+                         bool tail) {
+  // Macro expansion: call with unevaluated args, then evaluate result.
+  if (callable->kind() == Callable::Kind::kMacro) {
+    // The macro body may have emitted a TailCall (if its last expression
+    // was a tail-position user-fn call). Trampoline it to get the actual
+    // expanded form before re-evaluating it as code.
+    auto expanded = Trampoline(callable->Call(this, std::move(args)));
+    return EvaluateTail(std::move(expanded), tail);
+  }
+
+  // Tail-position non-lazy UserFn: evaluate args now, return TailCall
+  // sentinel for the trampoline to iterate without growing the C++ stack.
+  // A strict function that forwards tail position (eval) gets it only once
+  // its arguments have been evaluated, outside of it.
+  if (tail && (callable->kind() == Callable::Kind::kUserFn ||
+               (callable->is_strict() && callable->forwards_tail_position()))) {
+    ExprList evaluated;
+    for (auto& arg : args) {
+      evaluated.push_back(Evaluate(std::move(arg)));
+    }
+    return ApplyEvaluated(callable, std::move(evaluated), true);
+  }
+
+  // A lazy function takes its arguments as they are, so a tail call of one
+  // is deferred to the trampoline just like that of a strict one.
+  if (tail && callable->kind() == Callable::Kind::kLazyFn) {
+    return TailCall{callable, std::move(args)};
+  }
+
+  // Only the forms that forward tail position (if, do, and, or) may see
+  // tail_position_=true; Let uses EvaluateBody internally. All other
+  // callables evaluate sub-expressions that are not in tail position.
+  if (tail && callable->forwards_tail_position()) {
+    set_tail_position(true);
+  }
+
+  auto call_result = callable->Call(this, std::move(args));
+
+  // Non-tail context: run trampoline loop until a real value is returned.
+  if (!tail) {
+    return Trampoline(std::move(call_result));
+  }
+  return call_result;
+}
+
+Expr Interpreter::ApplyEvaluated(const callable_ptr_t& callable,
+                                 ExprList&& args, bool tail) {
+  if (tail && callable->kind() == Callable::Kind::kUserFn) {
+    return TailCall{callable, std::move(args)};
+  }
+  if (tail && callable->forwards_tail_position()) {
+    set_tail_position(true);
+  }
+  auto result = static_cast<Function*>(callable.get())
+                    ->CallEvaluated(this, std::move(args));
+  return tail ? std::move(result) : Trampoline(std::move(result));
+}
+
+Expr Interpreter::Execute(const Body& body, std::shared_ptr<Environment> env) {
+  auto old_env = std::exchange(env_, std::move(env));
+  auto restore = defer([&]() { env_ = std::move(old_env); });
+  return body.Exec(this);
+}
+
+std::shared_ptr<Interpreter::Environment> Interpreter::NewFrame(
+    std::shared_ptr<Environment> parent, size_t num_slots) {
+  if (spare_frames_.empty()) {
+    return NewEnvironment(std::move(parent), num_slots);
+  }
+  auto frame = std::move(spare_frames_.back());
+  spare_frames_.pop_back();
+  frame->Reset(std::move(parent), num_slots);
+  return frame;
+}
+
+void Interpreter::ReleaseFrame(std::shared_ptr<Environment>&& frame) {
+  // Enough for the frames of one deep call chain to be reused by the next,
+  // without holding on to all the frames of an unusually deep recursion.
+  constexpr size_t kMaxSpareFrames = 256;
+  if (frame.use_count() != 1 || spare_frames_.size() >= kMaxSpareFrames) {
+    return;
+  }
+  // Drops the values, and the parent, now rather than on reuse.
+  frame->Reset(nullptr, 0);
+  spare_frames_.push_back(std::move(frame));
+}
+
+std::shared_ptr<Interpreter::Environment> Interpreter::NewEnvironment(
+    std::shared_ptr<Environment> parent, size_t num_slots) {
+  if (environments_.size() >= next_collection_) {
+    Collect();
+  }
+  auto env = std::allocate_shared<Environment>(Allocator<Environment>(),
+                                               std::move(parent), num_slots);
+  environments_.push_back(env);
+  return env;
+}
+
+void Interpreter::Collect() {
+  const auto start = std::chrono::steady_clock::now();
+  size_t freed = 0;
+  size_t objects = 0;
+  {
+    // Held until the end, so that nothing is freed before the sweep.
+    std::vector<std::shared_ptr<Environment>> envs;
+    envs.reserve(environments_.size());
+    for (const auto& env : environments_) {
+      if (auto locked = env.lock()) {
+        envs.push_back(std::move(locked));
+      }
+    }
+    const HeapGraph graph(envs);
+    environments_.clear();
+    std::vector<Environment*> garbage;
+    for (const auto& env : envs) {
+      if (graph.IsLive(env.get())) {
+        environments_.push_back(env);
+      } else {
+        garbage.push_back(env.get());
+      }
+    }
+    for (auto* env : garbage) {
+      env->Clear();
+    }
+    freed = garbage.size();
+    objects = graph.num_objects();
+  }
+  // A collection takes time in proportion to the graph it traced, so the
+  // next one waits for as many new environments as that.
+  next_collection_ =
+      std::max(kMinCollection, 2 * environments_.size() + objects);
+
+  const auto pause = std::chrono::steady_clock::now() - start;
+  ++gc_stats_.collections;
+  gc_stats_.environments_freed += freed;
+  gc_stats_.environments_live = environments_.size();
+  gc_stats_.last_pause = pause;
+  gc_stats_.max_pause = std::max(gc_stats_.max_pause, gc_stats_.last_pause);
+  gc_stats_.total_pause += pause;
+}
+
+void Interpreter::ThrowRecursionDepthError() const {
+  throw RecursionDepthError("Maximum recursion depth of " +
+                            std::to_string(max_depth_) + " exceeded");
+}
+
+Expr Interpreter::Trampoline(Expr&& result) {
+  while (auto* tc = std::get_if<TailCall>(&result)) {
+    if (tc->callable()->kind() != Callable::Kind::kSpecialForm) {
+      result = static_cast<Function*>(tc->callable().get())
+                   ->CallEvaluated(this, std::move(tc->args()));
+    } else {
+      // Only a recur that escaped its loop gets here, and it is not in a
+      // tail position any more.
+      set_tail_position(false);
+      result = tc->callable()->Call(this, std::move(tc->args()));
+    }
+  }
+  return std::move(result);
 }
 
 Expr Interpreter::Evaluate(ExprList&& exprs, std::shared_ptr<Environment> env) {
+  return Evaluate(static_cast<const ExprList&>(exprs), std::move(env));
+}
+
+Expr Interpreter::Evaluate(const ExprList& exprs,
+                           std::shared_ptr<Environment> env) {
+  AccountScope scope(memory_.get());
   auto old_env = env_;
   if (env) {
     env_ = env;
@@ -236,13 +566,16 @@ Expr Interpreter::Evaluate(ExprList&& exprs, std::shared_ptr<Environment> env) {
       this->env_ = old_env;
     }
   });
-  return std::accumulate(
-      make_move_iterator(exprs.begin()), make_move_iterator(exprs.end()),
-      Expr(nullptr),
-      [this](Expr&&, Expr&& rhs) { return Evaluate(std::move(rhs)); });
+  // Each form is analyzed only after the ones before it have run, since
+  // they may define the macros and special forms it uses.
+  Expr result{nullptr};
+  for (const auto& expr : exprs) {
+    result = Analyze(this, expr)->Exec(this);
+  }
+  return result;
 }
 
-Expr Interpreter::EvaluateBody(const ExprList& exprs,
+Expr Interpreter::EvaluateBody(const std::list<Expr>& exprs,
                                std::shared_ptr<Environment> env) {
   auto old_env = env_;
   if (env) env_ = env;
@@ -254,7 +587,7 @@ Expr Interpreter::EvaluateBody(const ExprList& exprs,
   for (auto it = exprs.begin(); it != exprs.end();) {
     auto next = std::next(it);
     if (next == exprs.end()) tail_position_ = true;  // mark last expr
-    result = Evaluate(Expr{*it});
+    result = Evaluate(*it);
     tail_position_ = false;  // always reset after each eval
     it = next;
   }
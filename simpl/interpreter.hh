@@ -3,74 +3,301 @@
 #ifndef SIMPL_INTERPRETER_HH_
 #define SIMPL_INTERPRETER_HH_
 
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <list>
 #include <memory>
+#include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include "simpl/ast.hh"
+#include "simpl/memory.hh"
+#include "simpl/rc.hh"
+#include "simpl/stack.hh"
 
 namespace simpl {
 
+class Body;
 class Callable;
+class Tracer;
 
 class Interpreter {
  public:
+  // Global bindings are kept in a table at the root, indexed by the id of the
+  // interned name, with a version that is bumped whenever a global is
+  // (re)defined so that call sites can cache what they looked up. Every other
+  // environment is a frame of slots filled in binding order, so that symbols
+  // resolved to a lexical address (see resolver.hh) are found by index.
   class Environment {
    public:
-    explicit Environment(std::shared_ptr<Environment> parent = nullptr)
-        : values_(), parent_(parent) {}
+    explicit Environment(std::shared_ptr<Environment> parent = nullptr,
+                         size_t num_slots = 0)
+        : parent_(parent), root_(parent ? parent->root_ : this) {
+      slots_.reserve(num_slots);
+      names_.reserve(num_slots);
+    }
+    Environment(const Environment&) = delete;
+    Environment& operator=(const Environment&) = delete;
+
+    // Empties the frame to be reused under `parent`, keeping the capacity of
+    // its slots.
+    void Reset(std::shared_ptr<Environment> parent, size_t num_slots) {
+      names_.clear();
+      slots_.clear();
+      parent_ = std::move(parent);
+      root_ = parent_ ? parent_->root_ : this;
+      slots_.reserve(num_slots);
+      names_.reserve(num_slots);
+    }
 
-    void Define(const std::string& name, auto&& value) {
-      if (parent_) {
-        return parent_->Define(name, std::forward<decltype(value)>(value));
+    void Define(const Atom* name, auto&& value) {
+      auto& cells = root_->cells_;
+      if (name->id >= cells.size()) {
+        cells.resize(name->id + 1);
+      }
+      auto& cell = cells[name->id];
+      if (cell) {
+        cell->value = std::forward<decltype(value)>(value);
       } else {
-        values_[name] = std::forward<decltype(value)>(value);
+        cell = std::make_unique<Cell>(
+            Cell{std::forward<decltype(value)>(value), 0});
       }
+      cell->version = ++root_->version_;
     }
 
-    void Bind(const std::string& name, auto&& value) {
-      values_.insert_or_assign(name, std::forward<decltype(value)>(value));
+    void Define(std::string_view name, auto&& value) {
+      Define(Intern(name), std::forward<decltype(value)>(value));
     }
 
-    const Expr& Get(auto&& name) const {
-      auto it = values_.find(name);
-      if (it != values_.end()) {
-        return it->second;
+    // Binds `name` to the next slot of this frame.
+    void Bind(const Atom* name, auto&& value) {
+      names_.push_back(name);
+      slots_.emplace_back(std::forward<decltype(value)>(value));
+    }
+
+    // Replaces the value of a bound slot, for a loop or a self tail call that
+    // reuses its frame.
+    void Rebind(size_t slot, Expr&& value) { slots_[slot] = std::move(value); }
+
+    const Expr& Get(const Atom* name) const {
+      for (const Environment* env = this; env->parent_;
+           env = env->parent_.get()) {
+        for (auto i = env->names_.size(); i-- > 0;) {
+          if (env->names_[i] == name) {
+            return env->slots_[i];
+          }
+        }
       }
-      if (parent_) {
-        return parent_->Get(std::forward<decltype(name)>(name));
+      if (const Expr* value = Find(name)) {
+        return *value;
       }
-      throw std::runtime_error("Undefined variable '" + name + "'");
+      throw std::runtime_error("Undefined variable '" + name->name + "'");
+    }
+
+    // Returns the value at a lexical address: `slot` of the frame `depth`
+    // levels up the chain.
+    const Expr& Get(size_t depth, size_t slot) const {
+      const Environment* env = this;
+      while (depth-- > 0) {
+        env = env->parent_.get();
+      }
+      return env->slots_[slot];
+    }
+
+    // Returns a pointer to the global binding for `name`, or nullptr if it is
+    // unbound. Bindings are only erased by Clear, which bumps the version, so
+    // the pointer stays valid as long as the version does not change.
+    const Expr* Find(const Atom* name) const {
+      const auto& cells = root_->cells_;
+      return name->id < cells.size() && cells[name->id]
+                 ? &cells[name->id]->value
+                 : nullptr;
+    }
+
+    const Expr* Find(std::string_view name) const {
+      return Find(Intern(name));
+    }
+
+    // Number of global definitions made so far, and of times the globals
+    // were cleared.
+    uint64_t version() const { return root_->version_; }
+
+    // The version at which `name` was last defined, or 0 if it is unbound.
+    // It changes whenever the binding does, and never comes back to a value
+    // it had before.
+    uint64_t version(const Atom* name) const {
+      const auto& cells = root_->cells_;
+      return name->id < cells.size() && cells[name->id]
+                 ? cells[name->id]->version
+                 : 0;
     }
 
+    const Environment* parent() const { return parent_.get(); }
+    const AccountedVector<const Atom*>& names() const { return names_; }
+
+    // Reports the parent and the values of the frame to `tracer`.
+    void Trace(Tracer& tracer) const;
+    // Drops everything the frame refers to, to break a cycle through it.
+    void Clear();
+
    private:
-    std::unordered_map<std::string, Expr> values_;
+    AccountedVector<const Atom*> names_;
+    AccountedVector<Expr> slots_;
     std::shared_ptr<Environment> parent_;
+    // Owned by the root, which outlives every frame that points to it.
+    Environment* root_;
+    // A global binding and the version it was defined at.
+    struct Cell {
+      Expr value;
+      uint64_t version;
+    };
+
+    AccountedVector<std::unique_ptr<Cell>> cells_;
+    uint64_t version_ = 0;
+  };
+
+  // What the cycle collector has done so far.
+  struct GcStats {
+    uint64_t collections = 0;
+    uint64_t environments_freed = 0;
+    // Environments that survived the last collection.
+    size_t environments_live = 0;
+    std::chrono::nanoseconds last_pause{0};
+    std::chrono::nanoseconds max_pause{0};
+    std::chrono::nanoseconds total_pause{0};
   };
 
+  // Values, environments and callables are charged to the interpreter while
+  // it evaluates code.
   Interpreter();
-  virtual ~Interpreter() = default;
+  // Collects the globals too, unless a value that outlives the interpreter
+  // still refers to them.
+  virtual ~Interpreter();
   Expr Evaluate(Expr&& expr);
+  // Evaluates `expr` in place; only the result is materialized.
+  Expr Evaluate(const Expr& expr);
   Expr Evaluate(ExprList&& expr, std::shared_ptr<Environment> env = nullptr);
   Expr Evaluate(const ExprList& expr,
                 std::shared_ptr<Environment> env = nullptr);
-  Expr EvaluateBody(const ExprList& exprs,
+  Expr EvaluateBody(const std::list<Expr>& exprs,
                     std::shared_ptr<Environment> env = nullptr);
+  // Evaluates `form` in tail position if `tail` is set, where a call returns
+  // a TailCall for the caller's trampoline.
+  Expr EvaluateTail(Expr&& form, bool tail);
+  // Calls `callable` with unevaluated `args`, expanding macros. In tail
+  // position a call of a user function returns a TailCall instead.
+  Expr Apply(const callable_ptr_t& callable, ExprList&& args, bool tail);
+  // Same for a strict Function whose arguments have been evaluated already.
+  Expr ApplyEvaluated(const callable_ptr_t& callable, ExprList&& args,
+                      bool tail);
+  // Runs an analyzed body (see analyzer.hh) in `env`.
+  Expr Execute(const Body& body, std::shared_ptr<Environment> env);
+  // Returns an empty frame for a call or a let, reusing one that was given
+  // back by ReleaseFrame if there is any.
+  std::shared_ptr<Environment> NewFrame(std::shared_ptr<Environment> parent,
+                                        size_t num_slots);
+  // Takes back a frame from NewFrame once its code has run. Unless a closure
+  // or a child frame still refers to it, the frame is kept for reuse, so
+  // calls that capture nothing allocate no environment.
+  void ReleaseFrame(std::shared_ptr<Environment>&& frame);
+  // Returns a new environment, which the cycle collector keeps track of.
+  // Every environment but the globals is made here. May run a collection.
+  std::shared_ptr<Environment> NewEnvironment(
+      std::shared_ptr<Environment> parent, size_t num_slots = 0);
+
+  // Frees the environments, and the closures they hold, that only refer to
+  // one another. References are counted, so only cycles are left for the
+  // collector: it tells them apart by counting the references among the
+  // environments and the objects reachable from them (callables, the cells
+  // and nodes of lists, vectors and maps, and quoted forms), and then marks
+  // what is reachable from the ones with references from anywhere else. A
+  // cycle through an aggregate is thus freed like any other. Runs on its own
+  // as environments are made.
+  void Collect();
+  const GcStats& gc_stats() const { return gc_stats_; }
+
+  // The memory charged to the interpreter; see MemoryAccount for setting a
+  // limit.
+  MemoryAccount& memory() const { return *memory_; }
+  // The most calls that may be nested, in the interpreter and the VM
+  // together, before a RecursionDepthError is thrown. Their frames are on the
+  // heap (see stack.hh), so this is what bounds recursion, along with any
+  // memory limit.
+  static constexpr size_t kDefaultMaxDepth = 1000000;
+  size_t max_depth() const { return max_depth_; }
+  void set_max_depth(size_t max_depth) { max_depth_ = max_depth; }
+  // Returns `fn()`, run as a call nested in the ones being made.
+  template <typename F>
+  Expr Nest(F&& fn) {
+    EnterCall();
+    struct Unnest {
+      Interpreter* interpreter;
+      ~Unnest() { interpreter->LeaveCall(); }
+    } unnest{this};
+    return WithStack(std::forward<F>(fn));
+  }
+  // Count a call that is not made through Nest, such as one between VM
+  // frames, so that both engines share one depth and one limit.
+  void EnterCall() {
+    if (depth_ >= max_depth_) {
+      ThrowRecursionDepthError();
+    }
+    ++depth_;
+  }
+  void LeaveCall() { --depth_; }
+  [[noreturn]] void ThrowRecursionDepthError() const;
+
+  // Runs pending TailCalls in `result` until a real value is produced.
+  Expr Trampoline(Expr&& result);
   std::shared_ptr<Environment> env() const { return env_; }
+  const Environment& frame() const { return *env_; }
+  const std::shared_ptr<Environment>& globals() const { return globals_; }
   bool tail_position() const { return tail_position_; }
   void set_tail_position(bool v) { tail_position_ = v; }
+  // The values of the analyzed `recur`s whose loops have yet to rebind them,
+  // those of the innermost loop last (see analyzer.cc).
+  std::vector<Expr>& recur_values() { return recur_values_; }
 
  private:
   struct EvalVisitor;
+  const Rc<MemoryAccount> memory_;
+  std::shared_ptr<Environment> globals_;
   std::shared_ptr<Environment> env_;
+  // Frames given back by ReleaseFrame, most recently released last.
+  std::vector<std::shared_ptr<Environment>> spare_frames_;
+  // Every environment made since the last collection, and the survivors.
+  std::vector<std::weak_ptr<Environment>> environments_;
+  size_t next_collection_;
+  GcStats gc_stats_;
+  std::vector<Expr> recur_values_;
+  size_t depth_ = 0;
+  size_t max_depth_ = kDefaultMaxDepth;
   bool tail_position_ = false;
 };
 
+// Visits the references the cycle collector follows (see
+// Interpreter::Collect).
+class Tracer {
+ public:
+  // Reports what a shared object refers to, by calling the tracer back.
+  using TraceFn = void (*)(const void* object, Tracer& tracer);
+
+  virtual ~Tracer() = default;
+  virtual void Visit(const Interpreter::Environment* env) = 0;
+  virtual void Visit(const Expr& value) = 0;
+  virtual void Visit(const callable_ptr_t& callable) = 0;
+  // A reference-counted object that values share, such as a cons cell, with
+  // `use_count` references to it in all. `trace` is called with the object
+  // when the tracer follows it.
+  virtual void VisitShared(const void* object, uint32_t use_count,
+                           TraceFn trace) = 0;
+};
+
 }  // namespace simpl
 
 #endif  // SIMPL_INTERPRETER_HH_
@@ -3,14 +3,22 @@
 #include "simpl/interpreter.hh"
 
 #include <gtest/gtest.h>
+#include <pthread.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
 #include "simpl/ast.hh"
+#include "simpl/callable.hh"
+#include "simpl/function.hh"
 #include "simpl/interpreter_util.hh"
 #include "simpl/lexer.hh"
+#include "simpl/memory.hh"
 #include "simpl/parser.hh"
+#include "simpl/stack.hh"
 
 namespace simpl {
 
@@ -155,6 +163,11 @@ TEST_F(InterpreterTest, EvalVariadic) {
             2);
 }
 
+TEST_F(InterpreterTest, HeadOfAString) {
+  EXPECT_EQ(std::get<int_type>(Eval("(head \"abc\")")), 97);
+  EXPECT_EQ(std::get<int_type>(Eval("(head \"a longer string\")")), 97);
+}
+
 TEST_F(InterpreterTest, EmptyRestArgs) {
   EXPECT_TRUE(std::get<bool>(Eval("(defn foo [a & b] (empty? b)) (foo 1)")));
 }
@@ -196,6 +209,12 @@ TEST_F(InterpreterTest, KeyMap) {
   EXPECT_EQ(1, std::get<int_type>(Eval("(let [m {:a 1 :b 2}] (:a m))")));
 }
 
+TEST_F(InterpreterTest, KeyMapVariables) {
+  EXPECT_EQ(10, std::get<int_type>(Eval("(def g {:a 3}) (defn f [m] (:a m))"
+                                        "(+ (f g) (:a g) (let [m g] (:a m))"
+                                        "   (f {:a 1}))")));
+}
+
 TEST_F(InterpreterTest, LazyFn) {
   EXPECT_EQ(2, std::get<int_type>(Eval("(let [f (lazy-fn [a] (eval (head a)))] "
                                        "(f ((/ 2 1) (/ 2 0))))")));
@@ -261,13 +280,112 @@ TEST_F(InterpreterTest, TailCallOptimizationSelfRecursion) {
       int_type{0});
 }
 
+TEST_F(InterpreterTest, SelfTailCallsRebindTheirFrame) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn fib-iter [n a b] "
+                     "  (if (= n 0) a (fib-iter (- n 1) b (+ a b)))) "
+                     "(fib-iter 50 0 1)")),
+            12586269025);
+  EXPECT_EQ(Eval("(defn last [x & xs] (if (empty? xs) x (last xs))) "
+                 "(last 1 2 3)"),
+            Eval("'(2 3)"));
+  // Closures made in a call keep the bindings of that call.
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn collect [n fs] "
+                     "  (if (= n 0) fs (collect (- n 1) (cons (fn [] n) fs)))) "
+                     "(def fs (collect 2 ())) "
+                     "(+ ((head fs)) (* 10 ((head (tail fs)))))")),
+            21);
+}
+
+TEST_F(InterpreterTest, TooFewArguments) {
+  EXPECT_THROW(Eval("(defn f [x] x) (f)"), std::runtime_error);
+  EXPECT_THROW(Eval("(defn g [x y] (if (= x 0) y (g (- x 1)))) (g 3 0)"),
+               std::runtime_error);
+  EXPECT_EQ(std::get<int_type>(Eval("(defn h [x] x) (h 1 2)")), 1);
+}
+
+TEST_F(InterpreterTest, TailCallsThroughDoAndOrAndLet) {
+  EXPECT_FALSE(std::get<bool>(
+      Eval("(defn even [n] (or (= n 0) (odd (- n 1)))) "
+           "(defn odd [n] (and (not (= n 0)) (even (- n 1)))) "
+           "(even 1000001)")));
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn down [n] "
+                     "  (do (+ n 1) (if (= n 0) 7 (down (- n 1))))) "
+                     "(down 1000000)")),
+            7);
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn f [n] (let [m (- n 1)] (if (< m 0) n (g m)))) "
+                     "(defn g [n] (let [m (- n 1)] (do (f m)))) "
+                     "(f 1000000)")),
+            0);
+}
+
+TEST_F(InterpreterTest, TailCallsThroughEvalAndLazyFn) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn f [n] (if (= n 0) 0 (eval `(g ~(- n 1))))) "
+                     "(defn g [n] (eval `(f ~(- n 1)))) "
+                     "(f 200000)")),
+            0);
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(def ping (lazy-fn [n] (pong n))) "
+                     "(defn pong [n] "
+                     "  (if (= n 0) 5 (eval `(ping ~(- n 1))))) "
+                     "(ping 200000)")),
+            5);
+}
+
+TEST_F(InterpreterTest, TailPositionKeepsShortCircuiting) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn f [x] (or (and x (g)) 3)) (defn g [] false) "
+                     "(f true)")),
+            3);
+  EXPECT_FALSE(std::get<bool>(Eval("(defn h [] (and false (undefined))) (h)")));
+  EXPECT_EQ(std::get<int_type>(Eval("(defn id [x] (if true x 0)) "
+                                    "(defn k [] (or (id nil) (id 2) (id 3))) "
+                                    "(+ (k) (id 1))")),
+            3);
+  EXPECT_TRUE(holds<std::nullptr_t>(Eval("(defn e [] (do)) (e)")));
+}
+
+TEST_F(InterpreterTest, LoopRebindsItsNames) {
+  EXPECT_EQ(std::get<int_type>(Eval(
+                "(loop [i 0 acc 0] (if (= i 10) acc (recur (+ i 1) (+ acc i))))")),
+            45);
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn countdown [n] "
+                     "  (loop [n n] (if (= n 0) 7 (recur (- n 1))))) "
+                     "(countdown 1000000)")),
+            7);
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(loop [i 0] (do (let [j (+ i 1)] "
+                     "  (or (and (>= j 5) j) (recur j)))))")),
+            5);
+}
+
+TEST_F(InterpreterTest, ClosuresMadeInALoopKeepTheirBindings) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(def fs (loop [i 3 fs ()] "
+                     "  (if (= i 0) fs (recur (- i 1) (cons (fn [] i) fs))))) "
+                     "(+ ((head fs)) (* 10 ((head (tail fs)))))")),
+            21);
+}
+
+TEST_F(InterpreterTest, RecurOutsideTheTailOfALoop) {
+  EXPECT_THROW(Eval("(recur 1)"), std::runtime_error);
+  EXPECT_THROW(Eval("(loop [i 0] (+ 1 (recur 1)))"), std::runtime_error);
+  EXPECT_THROW(Eval("(loop [i 0] ((fn [] (recur 1))))"), std::runtime_error);
+  EXPECT_THROW(Eval("(loop [i 0] (recur 1 2))"), std::runtime_error);
+}
+
 // Macro system tests
 
 TEST_F(InterpreterTest, SyntaxQuoteReturnsList) {
   EXPECT_TRUE(holds<List>(Eval("`(a b c)")));
   auto list = std::get<List>(Eval("`(a b c)"));
   EXPECT_EQ(list.size(), 3);
-  EXPECT_EQ(std::get<Symbol>(list.front()).name, "a");
+  EXPECT_EQ(std::get<Symbol>(list.front()).name(), "a");
 }
 
 TEST_F(InterpreterTest, SyntaxQuoteWithUnquote) {
@@ -281,7 +399,7 @@ TEST_F(InterpreterTest, SyntaxQuoteWithSplice) {
   auto result = Eval("(def args '(1 2 3)) `(+ ~@args)");
   auto list = std::get<List>(result);
   EXPECT_EQ(list.size(), 4);
-  EXPECT_EQ(std::get<Symbol>(list.front()).name, "+");
+  EXPECT_EQ(std::get<Symbol>(list.front()).name(), "+");
 }
 
 TEST_F(InterpreterTest, SpliceOutsideSyntaxQuote) {
@@ -317,7 +435,7 @@ TEST_F(InterpreterTest, MacroexpandReturnsExpandedForm) {
   EXPECT_TRUE(holds<List>(result));
   auto list = std::get<List>(result);
   EXPECT_EQ(list.size(), 4);
-  EXPECT_EQ(std::get<Symbol>(list.front()).name, "if");
+  EXPECT_EQ(std::get<Symbol>(list.front()).name(), "if");
 }
 
 TEST_F(InterpreterTest, MacroAccessesCallerScope) {
@@ -372,4 +490,367 @@ TEST_F(InterpreterTest, MacroBodyTailCallTrampoline) {
             7);
 }
 
+// Lexical addressing: locals resolved to (depth, slot) must agree with
+// name-based lookup in all the places the resolver leaves alone.
+
+TEST_F(InterpreterTest, ResolvedLocalsInNestedClosures) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn adder [a] (fn [b] (fn [c] "
+                                    "(let [d 4] (+ a b c d))))) "
+                                    "(((adder 1) 2) 3)")),
+            10);
+}
+
+TEST_F(InterpreterTest, ResolvedLetShadowsParameter) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn f [a b] (let [a 10] (+ a b))) "
+                                    "(f 1 2)")),
+            12);
+}
+
+TEST_F(InterpreterTest, ResolvedLocalsInSyntaxQuote) {
+  auto list = std::get<List>(Eval("(defn f [x] `(a ~x)) (f 2)"));
+  EXPECT_EQ(std::get<int_type>(list.back()), 2);
+}
+
+TEST_F(InterpreterTest, LazyLocalCalleeEvaluatesFormsInItsOwnFrame) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn g [x] (let [f (lazy-fn [a] (eval a))] (f x))) "
+                     "(g 1)")),
+            1);
+}
+
+TEST_F(InterpreterTest, FlatClosureCapturesEnclosingLocals) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn make [a b] (let [c 3] (fn [x] (fn [] (+ a c x)))))"
+                     "(((make 1 2) 4))")),
+            8);
+}
+
+TEST_F(InterpreterTest, ClosureCallingMacroSeesEnclosingLocals) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defmacro getx [] 'x)"
+                                    "(defn f [x] ((fn [] (getx)))) (f 5)")),
+            5);
+}
+
+TEST_F(InterpreterTest, SpecialFormRedefinedAfterFunctionDefinition) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn f [x] (if x 1 2))"
+                                    "(def if (fn [a b c] 42)) (f true)")),
+            42);
+}
+
+TEST_F(InterpreterTest, CalleeRedefinedAsMacroAfterFunctionDefinition) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn g [x] x) (defn f [y] (g (+ y 1)))"
+                                    "(defmacro g [e] `(let [z 0] ~e)) (f 3)")),
+            4);
+}
+
+TEST_F(InterpreterTest, CachedCalleeRedefined) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn g [x] x) (defn f [y] (g y))"
+                                    "(f 1) (defn g [x] (* x 10)) (f 2)")),
+            20);
+  EXPECT_THROW(Eval("(def g 7) (f 3)"), std::runtime_error);
+}
+
+TEST_F(InterpreterTest, CalleeRedefinesItselfDuringCall) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn h [x] (defn h [y] (+ y 100)) x)"
+                                    "(defn f [x] (+ (h x) (h x))) (f 1)")),
+            102);
+}
+
+TEST_F(InterpreterTest, GlobalVersion) {
+  auto version = [this] { return interpreter_.globals()->version(); };
+  auto before = version();
+  Eval("(def a 1) (defn f [] a) (defmacro m [] 1)");
+  EXPECT_EQ(version(), before + 3);
+  Eval("(f)");
+  EXPECT_EQ(version(), before + 3);
+}
+
+TEST_F(InterpreterTest, ClosuresOfOneFormCaptureTheirOwnValues) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn adder [n] (fn [x] (+ x n)))"
+                                    "(let [a (adder 1) b (adder 2)]"
+                                    "  (+ (a 10) (b 10)))")),
+            23);
+}
+
+TEST_F(InterpreterTest, FunctionFormReanalyzedAfterRedefinition) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn g [] 1)"
+                                    "(defn make [y] (fn [] (+ y (g))))"
+                                    "((make 10))"
+                                    "(defmacro g [] 'y)"
+                                    "((make 20))")),
+            40);
+}
+
+TEST_F(InterpreterTest, FunctionFormReanalyzedWhenAHeadIsDefined) {
+  Eval("(defn make [y] (fn [] (+ y (g))))");
+  EXPECT_THROW(Eval("((make 10))"), std::runtime_error);
+  EXPECT_EQ(std::get<int_type>(Eval("(def unrelated 1)"
+                                    "(defmacro g [] 'y)"
+                                    "((make 20))")),
+            40);
+}
+
+TEST_F(InterpreterTest, SharedSubformsResolvedInEachPlace) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(def body '(+ x 1))"
+                     "(def f (eval `(fn [x] (+ (let [y 5 x 10] ~body) ~body))))"
+                     "(f 1)")),
+            13);
+}
+
+TEST_F(InterpreterTest, CapturedFramesAreNotReused) {
+  // The closures close over the whole frame of `make`, as they call eval.
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn make [n]"
+                     "  (let [m (* n 10)] (fn [] (eval '(+ n m)))))"
+                     "(def f (make 1)) (def g (make 2))"
+                     "(defn add [a b] (let [c a] (+ c b))) (add 100 200)"
+                     "(+ (f) (g) (add 1 2))")),
+            36);
+}
+
+TEST_F(InterpreterTest, FramesReusedAfterAnError) {
+  EXPECT_THROW(Eval("(defn f [x] (let [y x] (head y))) (f 1)"),
+               std::exception);
+  EXPECT_EQ(std::get<int_type>(Eval("(defn g [a b] (let [c a] (+ c b))) "
+                                    "(+ (g 1 2) (f '(4 5)))")),
+            7);
+}
+
+TEST_F(InterpreterTest, CollectFreesCycles) {
+  auto env = interpreter_.NewEnvironment(interpreter_.globals());
+  std::weak_ptr<Interpreter::Environment> weak = env;
+  {
+    // A closure over the whole of `env`, bound in `env` itself.
+    Lexer lexer("(fn [] (eval 'f))");
+    Parser parser(lexer.scan());
+    env->Bind(Intern("f"), interpreter_.Evaluate(parser.Parse(), env));
+  }
+  env = nullptr;
+  EXPECT_FALSE(weak.expired());
+  interpreter_.Collect();
+  EXPECT_TRUE(weak.expired());
+  EXPECT_EQ(interpreter_.gc_stats().collections, 1);
+  EXPECT_EQ(interpreter_.gc_stats().environments_freed, 1);
+}
+
+TEST_F(InterpreterTest, CollectKeepsReachableClosures) {
+  Eval("(defn make [n] (fn [] (eval 'n))) (def f (make 42))");
+  interpreter_.Collect();
+  EXPECT_EQ(std::get<int_type>(Eval("(f)")), 42);
+  EXPECT_EQ(interpreter_.gc_stats().environments_freed, 0);
+}
+
+TEST(Interpreter, GlobalsFreedWithTheInterpreter) {
+  auto interpreter = std::make_unique<Interpreter>();
+  Lexer lexer("(defn f [x] (if (= x 0) 0 (f (- x 1)))) (f 3)");
+  Parser parser(lexer.scan());
+  interpreter->Evaluate(parser.Parse());
+  std::weak_ptr<Interpreter::Environment> globals = interpreter->globals();
+  interpreter = nullptr;
+  EXPECT_TRUE(globals.expired());
+}
+
+// Aggregates in the globals that hold functions, or the forms of them, and
+// closures over the globals. Run under LeakSanitizer this also checks that
+// nothing else in such a cycle is left.
+TEST(Interpreter, GlobalAggregatesFreedWithTheInterpreter) {
+  for (const char* source :
+       {"(def fs [(fn [] 1)])", "(def fs (cons (fn [] 1) nil)) ((head fs))",
+        "(defn f [] fs) (def fs (cons f (cons 'x nil)))"}) {
+    auto interpreter = std::make_unique<Interpreter>();
+    Lexer lexer(source);
+    Parser parser(lexer.scan());
+    interpreter->Evaluate(parser.Parse());
+    std::weak_ptr<Interpreter::Environment> globals = interpreter->globals();
+    interpreter = nullptr;
+    EXPECT_TRUE(globals.expired()) << source;
+  }
+}
+
+TEST_F(InterpreterTest, CollectFreesCyclesThroughAggregates) {
+  auto env = interpreter_.NewEnvironment(interpreter_.globals());
+  std::weak_ptr<Interpreter::Environment> weak = env;
+  {
+    Lexer lexer("(cons (fn [] (eval 'fs)) nil)");
+    Parser parser(lexer.scan());
+    env->Bind(Intern("fs"), interpreter_.Evaluate(parser.Parse(), env));
+  }
+  env = nullptr;
+  interpreter_.Collect();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST_F(InterpreterTest, MemoryUsage) {
+  auto& memory = interpreter_.memory();
+  // The built-ins and their environment, charged without a limit.
+  const auto before = memory.used();
+  EXPECT_GT(before, 0);
+  Eval("(defn build [n acc] (if (= n 0) acc (build (- n 1) (cons n acc))))"
+       "(def l (build 1000 nil))");
+  const auto with_list = memory.used();
+  EXPECT_GT(with_list, before + 1000 * sizeof(Expr));
+  Eval("(def l nil)");
+  EXPECT_LT(memory.used(), with_list);
+  EXPECT_GE(memory.peak(), with_list);
+}
+
+TEST_F(InterpreterTest, MemoryLimit) {
+  auto& memory = interpreter_.memory();
+  Eval("(defn build [n acc] (if (= n 0) acc (build (- n 1) (cons n acc))))");
+  memory.set_limit(memory.used() + 64 * 1024);
+  EXPECT_THROW(Eval("(build 1000000 nil)"), MemoryLimitError);
+  EXPECT_LE(memory.used(), memory.limit());
+  // What was allocated by the failed evaluation has been given back.
+  EXPECT_EQ(std::get<List>(Eval("(build 100 nil)")).size(), 100);
+}
+
+// Values made before there was a limit count towards it and are credited
+// when they are freed after.
+TEST_F(InterpreterTest, MemoryLimitSetAfterAllocating) {
+  auto& memory = interpreter_.memory();
+  Eval("(defn build [n acc] (if (= n 0) acc (build (- n 1) (cons n acc))))");
+  const auto before = memory.used();
+  Eval("(def l (build 1000 nil))");
+  const auto with_l = memory.used();
+  EXPECT_GT(with_l, before + 1000 * sizeof(Expr));
+  memory.set_limit(with_l + 1024 * 1024);
+  EXPECT_EQ(memory.used(), with_l);
+  Eval("(def m (build 1000 l))");
+  const auto with_lists = memory.used();
+  EXPECT_GT(with_lists, with_l);
+  Eval("(def m nil)");
+  EXPECT_LT(memory.used(), with_lists);
+  Eval("(def l nil)");
+  EXPECT_LT(memory.used(), with_l);
+  // A limit below what is already used refuses anything more.
+  Eval("(def l (build 1000 nil))");
+  memory.set_limit(memory.used() - 1);
+  EXPECT_THROW(Eval("(build 10 nil)"), MemoryLimitError);
+  memory.set_limit(MemoryAccount::kUnlimited);
+  EXPECT_EQ(std::get<List>(Eval("(build 100 nil)")).size(), 100);
+}
+
+TEST_F(InterpreterTest, OverAlignedAccountedObjects) {
+  struct alignas(64) Aligned : Accounted {
+    char c;
+  };
+  auto& memory = interpreter_.memory();
+  AccountScope scope(&memory);
+  const auto before = memory.used();
+  for (auto limit : {MemoryAccount::kUnlimited, before + 1024 * 1024}) {
+    memory.set_limit(limit);
+    auto p = std::make_unique<Aligned>();
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p.get()) % alignof(Aligned), 0);
+    EXPECT_EQ(memory.used(), before + sizeof(Aligned));
+  }
+  EXPECT_EQ(memory.used(), before);
+}
+
+TEST_F(InterpreterTest, DeepRecursionRunsOnTheHeap) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn sum [n] (if (= n 0) 0 (+ n (sum (- n 1))))) "
+                     "(sum 200000)")),
+            20000100000);
+}
+
+// A thread with a stack smaller than the interpreter would use of it.
+TEST(Interpreter, DeepRecursionOnASmallThreadStack) {
+  constexpr std::size_t kStackSize = 192 * 1024;
+  pthread_attr_t attr;
+  ASSERT_EQ(pthread_attr_init(&attr), 0);
+  ASSERT_EQ(pthread_attr_setstacksize(&attr, kStackSize), 0);
+  int_type result = 0;
+  pthread_t thread;
+  ASSERT_EQ(pthread_create(
+                &thread, &attr,
+                [](void* result) -> void* {
+                  Interpreter interpreter;
+                  Lexer lexer(
+                      "(defn sum [n] (if (= n 0) 0 (+ n (sum (- n 1))))) "
+                      "(sum 10000)");
+                  Parser parser(lexer.scan());
+                  *static_cast<int_type*>(result) = std::get<int_type>(
+                      interpreter.Evaluate(parser.Parse()));
+                  return nullptr;
+                },
+                &result),
+            0);
+  pthread_join(thread, nullptr);
+  pthread_attr_destroy(&attr);
+  EXPECT_EQ(result, 50005000);
+}
+
+TEST_F(InterpreterTest, MaxDepth) {
+  Eval("(defn sum [n] (if (= n 0) 0 (+ n (sum (- n 1)))))");
+  interpreter_.set_max_depth(1000);
+  EXPECT_THROW(Eval("(sum 2000)"), RecursionDepthError);
+  EXPECT_EQ(std::get<int_type>(Eval("(sum 900)")), 405450);
+}
+
+TEST_F(InterpreterTest, MemoryLimitOnDeepRecursion) {
+  auto& memory = interpreter_.memory();
+  Eval("(defn sum [n] (if (= n 0) 0 (+ n (sum (- n 1)))))");
+  memory.set_limit(memory.used() + 8 * 1024 * 1024);
+  EXPECT_THROW(Eval("(sum 100000)"), MemoryLimitError);
+  EXPECT_EQ(std::get<int_type>(Eval("(sum 100)")), 5050);
+}
+
+TEST_F(InterpreterTest, CallableKinds) {
+  auto kind = [this](const std::string& source) {
+    return std::get<callable_ptr_t>(Eval(source))->kind();
+  };
+  EXPECT_EQ(kind("head"), Callable::Kind::kBuiltin);
+  EXPECT_EQ(kind("if"), Callable::Kind::kSpecialForm);
+  EXPECT_EQ(kind("(fn [x] x)"), Callable::Kind::kUserFn);
+  EXPECT_EQ(kind("(lazy-fn [x] x)"), Callable::Kind::kLazyFn);
+  EXPECT_EQ(kind("(defmacro m [x] x) m"), Callable::Kind::kMacro);
+}
+
+TEST_F(InterpreterTest, MacroArgumentsInsideFunction) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defmacro when [cond & body] `(if ~cond (do ~@body) nil))"
+                     "(defn f [x] (let [y 2] (when (> x 0) (* x y)))) (f 21)")),
+            42);
+}
+
+// Counts the times it is called.
+class Counter : public Function {
+ public:
+  explicit Counter(int* count) : count_(count) {}
+
+ private:
+  Expr FnCall(Interpreter*, args_type&&) override {
+    ++*count_;
+    return Expr{nullptr};
+  }
+  int* const count_;
+};
+
+TEST_F(InterpreterTest, MacroCallSitesExpandOnce) {
+  int expansions = 0;
+  interpreter_.globals()->Define("expanded!",
+                                 std::make_unique<Counter>(&expansions));
+  Eval("(defmacro twice [x] (do (expanded!) `(* 2 ~x)))"
+       "(defn f [n acc] (if (= n 0) acc (f (- n 1) (+ acc (twice n)))))");
+  EXPECT_EQ(std::get<int_type>(Eval("(f 100 0)")), 10100);
+  EXPECT_EQ(expansions, 1);
+  // Redefining the macro is seen by the call site.
+  Eval("(defmacro twice [x] `(* 3 ~x))");
+  EXPECT_EQ(std::get<int_type>(Eval("(f 100 0)")), 15150);
+}
+
+TEST_F(InterpreterTest, MacroCallSitesKeepTheirExpansionAcrossDefs) {
+  int expansions = 0;
+  interpreter_.globals()->Define("expanded!",
+                                 std::make_unique<Counter>(&expansions));
+  Eval("(defmacro twice [x] (do (expanded!) `(* 2 ~x)))"
+       "(defn f [n] (def last n) (twice n))");
+  EXPECT_EQ(std::get<int_type>(Eval("(f 1) (f 2) (f 3)")), 6);
+  EXPECT_EQ(expansions, 1);
+  // A macro runs once per call site, side effects included.
+  Eval("(def c 0) (defmacro m [] (def c (+ c 1)) c) (defn g [] (m))");
+  EXPECT_EQ(std::get<int_type>(Eval("(g) (g) (g) c")), 1);
+}
+
 }  // namespace simpl
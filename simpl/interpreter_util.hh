@@ -37,8 +37,8 @@ inline std::string TypeStr<Symbol>() {
 }
 
 template <>
-inline std::string TypeStr<std::string>() {
-  return "std::string";
+inline std::string TypeStr<String>() {
+  return "String";
 }
 
 template <>
@@ -4,9 +4,11 @@
 
 #include <cassert>
 #include <cctype>
-#include <list>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "simpl/error.hh"
 #include "simpl/token.hh"
@@ -15,7 +17,7 @@ namespace simpl {
 
 namespace {
 
-const std::unordered_map<std::string, Token::Type> kReserved{
+const std::unordered_map<std::string_view, Token::Type> kReserved{
     {"false", Token::kFalse},
     {"nil", Token::kNil},
     {"true", Token::kTrue},
@@ -36,17 +38,18 @@ bool CanEndNumber(char c) {
 
 }  // namespace
 
-Lexer::Lexer(const std::string &source) : source_(source), tokens_() {}
+Lexer::Lexer(const std::string &source)
+    : source_(source), text_(source_), tokens_() {}
 
-std::list<Token> Lexer::scan() {
+std::vector<Token> Lexer::scan() {
   while (!AtEnd()) {
     // We are at the beginning of the next lexeme.
     start_ = current_;
     ScanToken();
   }
 
-  tokens_.push_back(Token(Token::kEof, "", nullptr, line_));
-  return tokens_;
+  tokens_.emplace_back(Token::kEof, "", nullptr, line_);
+  return std::move(tokens_);
 }
 
 void Lexer::ScanToken() {
@@ -148,14 +151,14 @@ void Lexer::ScanToken() {
 
 bool Lexer::Match(char expected) {
   if (AtEnd()) return false;
-  if (source_[current_] != expected) return false;
+  if (text_[current_] != expected) return false;
   current_++;
   return true;
 }
 
 void Lexer::AddToken(Token::Type type, const Token::literal_t &literal) {
-  tokens_.push_back(
-      Token(type, source_.substr(start_, current_ - start_), literal, line_));
+  tokens_.emplace_back(type, text_.substr(start_, current_ - start_), literal,
+                       line_);
 }
 
 void Lexer::String() {
@@ -189,10 +192,10 @@ void Lexer::Number() {
   try {
     if (is_float) {
       AddToken(Token::kFloat,
-               std::stod(source_.substr(start_, current_ - start_)));
+               std::stod(std::string(text_.substr(start_, current_ - start_))));
     } else {
-      AddToken(Token::kInteger,
-               std::stoll(source_.substr(start_, current_ - start_)));
+      AddToken(Token::kInteger, std::stoll(std::string(
+                                    text_.substr(start_, current_ - start_))));
     }
   } catch (const std::invalid_argument &e) {
     Error(line_, "Invalid number.");
@@ -202,8 +205,7 @@ void Lexer::Number() {
 void Lexer::Symbol() {
   while (CanBeInSymbol(Peek())) Advance();
 
-  const auto text = source_.substr(start_, current_ - start_);
-  const auto it = kReserved.find(text);
+  const auto it = kReserved.find(text_.substr(start_, current_ - start_));
   it != kReserved.end() ? AddToken(it->second) : AddToken(Token::kSymbol);
 }
 
@@ -212,13 +214,12 @@ void Lexer::Keyword() {
   if (start_ + 2 > current_) {
     Error(line_, "Invalid keyword.");
   }
-  const auto text = source_.substr(start_ + 1, current_ - start_ - 1);
-  AddToken(Token::kKeyword, text);
+  AddToken(Token::kKeyword, source_.substr(start_ + 1, current_ - start_ - 1));
 }
 
 char Lexer::PeekNext() {
-  if (current_ + 1 >= source_.size()) return '\0';
-  return source_[current_ + 1];
+  if (current_ + 1 >= text_.size()) return '\0';
+  return text_[current_ + 1];
 }
 
 }  // namespace simpl
@@ -3,32 +3,40 @@
 #ifndef SIMPL_LEXER_HH_
 #define SIMPL_LEXER_HH_
 
-#include <list>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "simpl/string.hh"
 #include "simpl/token.hh"
 
 namespace simpl {
 
+// Scans a source into tokens, which are kept in one contiguous buffer and
+// refer to the source rather than copying their text: the Lexer must outlive
+// the tokens it returns.
 class Lexer {
  public:
   explicit Lexer(const std::string &source);
-  std::list<Token> scan();
+  Lexer(const Lexer &) = delete;
+  Lexer &operator=(const Lexer &) = delete;
+  std::vector<Token> scan();
 
  private:
-  bool AtEnd() { return current_ >= source_.length(); }
+  bool AtEnd() { return current_ >= text_.length(); }
   void ScanToken();
-  char Advance() { return source_[current_++]; }
+  char Advance() { return text_[current_++]; }
   void AddToken(Token::Type type, const Token::literal_t &literal = nullptr);
   bool Match(char expected);
-  char Peek() { return AtEnd() ? '\0' : source_[current_]; }
+  char Peek() { return AtEnd() ? '\0' : text_[current_]; }
   char PeekNext();
   void String();
   void Number();
   void Symbol();
   void Keyword();
-  const std::string source_;
-  std::list<Token> tokens_;
+  const simpl::String source_;
+  const std::string_view text_;  // Of source_
+  std::vector<Token> tokens_;
   size_t start_ = 0;
   size_t current_ = 0;
   size_t line_ = 1;
@@ -38,14 +38,14 @@ TEST(Lexer, String) {
   Lexer lexer("\"abc\"");
   auto tokens = lexer.scan();
   EXPECT_EQ(tokens.size(), 2);
-  EXPECT_EQ(std::get<std::string>(tokens.front().literal), "abc");
+  EXPECT_EQ(std::get<String>(tokens.front().literal), "abc");
 }
 
 TEST(Lexer, EmptyString) {
   Lexer lexer("\"\"");
   auto tokens = lexer.scan();
   EXPECT_EQ(tokens.size(), 2);
-  EXPECT_EQ(std::get<std::string>(tokens.front().literal), "");
+  EXPECT_EQ(std::get<String>(tokens.front().literal), "");
 }
 
 TEST(Lexer, Float) {
@@ -1,17 +1,24 @@
 // Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
 
 #include <iostream>
+#include <string>
 
 #include "simpl/simpl.hh"
 
 int main(int argc, char *argv[]) {
-  if (argc > 2) {
-    std::cout << "Usage: " << argv[0] << " [file]" << std::endl;
+  auto engine = simpl::Engine::kInterpreter;
+  int first_arg = 1;
+  if (argc > 1 && std::string(argv[1]) == "--vm") {
+    engine = simpl::Engine::kVM;
+    first_arg = 2;
+  }
+  if (argc - first_arg > 1) {
+    std::cout << "Usage: " << argv[0] << " [--vm] [file]" << std::endl;
     return 1;
-  } else if (argc == 2) {
-    simpl::RunFile(argv[1]);
+  } else if (argc - first_arg == 1) {
+    simpl::RunFile(argv[first_arg], engine);
   } else {
-    simpl::RunREPL();
+    simpl::RunREPL(engine);
   }
 
   return 0;
@@ -0,0 +1,83 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#include "simpl/memory.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <string>
+
+namespace simpl {
+
+namespace {
+
+thread_local MemoryAccount* current_account = nullptr;
+
+// A block charged to an account is preceded by a header, ending with the
+// account, as large as the block's alignment. Blocks are allocated aligned
+// to twice that, so a charged one is off it by the header and Deallocate can
+// tell the two apart.
+std::size_t HeaderSize(std::size_t alignment) {
+  return std::max(alignment, sizeof(MemoryAccount*));
+}
+
+bool IsCharged(const void* p, std::size_t header_size) {
+  return reinterpret_cast<std::uintptr_t>(p) & header_size;
+}
+
+}  // namespace
+
+void MemoryAccount::Charge(std::size_t bytes) {
+  if (limit_ != kUnlimited && bytes > limit_ - std::min(used_, limit_)) {
+    throw MemoryLimitError("Out of memory: the limit is " +
+                           std::to_string(limit_) + " bytes");
+  }
+  used_ += bytes;
+  peak_ = std::max(peak_, used_);
+}
+
+AccountScope::AccountScope(MemoryAccount* account)
+    : previous_(current_account) {
+  current_account = account;
+}
+
+AccountScope::~AccountScope() { current_account = previous_; }
+
+void* Allocate(std::size_t size, std::size_t alignment) {
+  const std::size_t header_size = HeaderSize(alignment);
+  const std::align_val_t block_alignment{2 * header_size};
+  MemoryAccount* account = current_account;
+  if (!account) {
+    return ::operator new(size, block_alignment);
+  }
+  account->Charge(size);
+  void* memory;
+  try {
+    memory = ::operator new(header_size + size, block_alignment);
+  } catch (...) {
+    account->Credit(size);
+    throw;
+  }
+  Retain(account);
+  auto* p = static_cast<char*>(memory) + header_size;
+  reinterpret_cast<MemoryAccount**>(p)[-1] = account;
+  return p;
+}
+
+void Deallocate(void* p, std::size_t size, std::size_t alignment) noexcept {
+  if (!p) {
+    return;
+  }
+  const std::size_t header_size = HeaderSize(alignment);
+  const std::align_val_t block_alignment{2 * header_size};
+  if (!IsCharged(p, header_size)) {
+    ::operator delete(p, block_alignment);
+    return;
+  }
+  MemoryAccount* account = static_cast<MemoryAccount**>(p)[-1];
+  account->Credit(size);
+  Release(account);
+  ::operator delete(static_cast<char*>(p) - header_size, block_alignment);
+}
+
+}  // namespace simpl
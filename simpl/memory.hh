@@ -0,0 +1,137 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_MEMORY_HH_
+#define SIMPL_MEMORY_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace simpl {
+
+class MemoryLimitError : public std::runtime_error {
+ public:
+  explicit MemoryLimitError(const std::string& msg)
+      : std::runtime_error(msg) {}
+};
+
+// The memory charged to an interpreter: the values, environments, callables
+// and stacks made while it runs (see AccountScope). Code is not charged: the
+// forms read, the nodes the analyzer makes of them and the chunks the VM
+// compiles them to; nor are the argument lists of calls in progress, which
+// are bounded by the stacks that are.
+//
+// Everything allocated while the account is current is charged, with or
+// without a limit, so that used() is right whenever a limit is set. A charged
+// allocation keeps a reference to its account, so it is credited to the
+// right one wherever it is freed, and an account lives as long as anything
+// charged to it. The reference costs each charged block a header of at
+// least a word; memory allocated outside any account (see AccountScope) has
+// none.
+class MemoryAccount {
+ public:
+  static constexpr std::size_t kUnlimited = SIZE_MAX;
+
+  MemoryAccount() = default;
+  MemoryAccount(const MemoryAccount&) = delete;
+  MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+  // Bytes currently charged, and the most there have been at a time.
+  std::size_t used() const { return used_; }
+  std::size_t peak() const { return peak_; }
+  std::size_t limit() const { return limit_; }
+  // Allocations that would take the account past `limit` bytes throw a
+  // MemoryLimitError. Memory already in use counts towards the limit but is
+  // not freed, even if it is over it.
+  void set_limit(std::size_t limit) { limit_ = limit; }
+
+  void Charge(std::size_t bytes);
+  void Credit(std::size_t bytes) { used_ -= bytes; }
+
+  friend void Retain(const MemoryAccount* account) { ++account->refs_; }
+  friend void Release(const MemoryAccount* account) {
+    if (--account->refs_ == 0) delete account;
+  }
+
+ private:
+  std::size_t used_ = 0;
+  std::size_t peak_ = 0;
+  std::size_t limit_ = kUnlimited;
+  mutable uint32_t refs_ = 0;
+};
+
+// Charges the allocations made on this thread to `account` (none if null)
+// until the scope ends.
+class AccountScope {
+ public:
+  explicit AccountScope(MemoryAccount* account);
+  ~AccountScope();
+  AccountScope(const AccountScope&) = delete;
+  AccountScope& operator=(const AccountScope&) = delete;
+
+ private:
+  MemoryAccount* const previous_;
+};
+
+// Allocates `size` bytes charged to the current account, aligned to
+// `alignment`, a power of two.
+void* Allocate(std::size_t size, std::size_t alignment = alignof(void*));
+// Frees memory from Allocate, of the same `size` and `alignment`.
+void Deallocate(void* p, std::size_t size,
+                std::size_t alignment = alignof(void*)) noexcept;
+
+// Makes objects of a class and its subclasses charged to the current
+// account. operator new is only told the alignment of a type aligned beyond
+// what it gives by default, so any other must need no more than pointer
+// alignment (see Accountable).
+struct Accounted {
+  static void* operator new(std::size_t size) { return Allocate(size); }
+  static void* operator new(std::size_t size, std::align_val_t alignment) {
+    return Allocate(size, static_cast<std::size_t>(alignment));
+  }
+  static void operator delete(void* p, std::size_t size) {
+    Deallocate(p, size);
+  }
+  static void operator delete(void* p, std::size_t size,
+                              std::align_val_t alignment) {
+    Deallocate(p, size, static_cast<std::size_t>(alignment));
+  }
+};
+
+// Whether Accounted allocates objects of type T suitably aligned.
+template <typename T>
+concept Accountable = alignof(T) <= alignof(void*) ||
+                        alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+// An allocator for standard containers that charges the current account.
+template <typename T>
+struct Allocator {
+  using value_type = T;
+
+  Allocator() = default;
+  template <typename U>
+  Allocator(const Allocator<U>&) {}  // NOLINT: rebinding is implicit
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T* p, std::size_t n) {
+    Deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  template <typename U>
+  bool operator==(const Allocator<U>&) const {
+    return true;
+  }
+};
+
+// A std::vector whose buffer is charged to the current account.
+template <typename T>
+using AccountedVector = std::vector<T, Allocator<T>>;
+
+}  // namespace simpl
+
+#endif  // SIMPL_MEMORY_HH_
@@ -2,6 +2,7 @@
 
 #include "simpl/parser.hh"
 
+#include <iterator>
 #include <memory>
 #include <string>
 #include <utility>
@@ -9,14 +10,24 @@
 #include "simpl/ast.hh"
 #include "simpl/config.hh"
 #include "simpl/error.hh"
+#include "simpl/util.hh"
 
 namespace simpl {
 
+namespace {
+
+bool IsQuotation(Token::Type type) {
+  return type == Token::Type::kQuote || type == Token::Type::kBacktick ||
+         type == Token::Type::kTilde || type == Token::Type::kTildeSplice;
+}
+
+}  // namespace
+
 Parser::ParseError Parser::Error(const Token& token,
                                  const std::string& message) {
   std::string where = (token.type == Token::Type::kEof)
                           ? " at end"
-                          : (" at '" + token.lexeme + "'");
+                          : (" at '" + std::string(token.lexeme) + "'");
   return ParseError(Report(token.line, where, message));
 }
 
@@ -34,26 +45,18 @@ ExprList Parser::Parse() {
 }
 
 Expr Parser::ParseSimpleExpr() {
-  auto token = Advance();
+  const auto& token = Advance();
   switch (token.type) {
     case Token::Type::kInteger:
       return Expr{std::get<int_type>(token.literal)};
     case Token::Type::kString:
-      return Expr{std::get<std::string>(token.literal)};
+      return Pool(Expr{std::get<String>(token.literal)});
     case Token::Type::kFloat:
       return Expr{std::get<float_type>(token.literal)};
     case Token::Type::kFalse:
       return Expr{false};
     case Token::Type::kTrue:
       return Expr{true};
-    case Token::Type::kQuote:
-      return Expr{Quoted(ParseExpr(), Quoted::Kind::kQuote)};
-    case Token::Type::kBacktick:
-      return Expr{Quoted(ParseExpr(), Quoted::Kind::kSyntaxQuote)};
-    case Token::Type::kTilde:
-      return Expr{Quoted(ParseExpr(), Quoted::Kind::kUnquote)};
-    case Token::Type::kTildeSplice:
-      return Expr{Quoted(ParseExpr(), Quoted::Kind::kSplice)};
     case Token::Type::kMinus:
     case Token::Type::kPlus:
     case Token::Type::kSlash:
@@ -69,7 +72,7 @@ Expr Parser::ParseSimpleExpr() {
     case Token::Type::kSymbol:
       return Expr{Symbol{token.lexeme}};
     case Token::Type::kKeyword:
-      return Expr{Keyword{std::get<std::string>(token.literal)}};
+      return Expr{Keyword{std::get<String>(token.literal)}};
     case Token::Type::kNil:
       return Expr{nullptr};
     default:
@@ -78,44 +81,108 @@ Expr Parser::ParseSimpleExpr() {
 }
 
 Expr Parser::ParseExpr() {
-  if (Match(Token::Type::kLeftParen)) {
-    return ParseList();
-  } else if (Match(Token::Type::kLeftBracket)) {
-    return ParseVector();
-  } else if (Match(Token::Type::kLeftBrace)) {
-    return ParseMap();
-  } else {
-    return ParseSimpleExpr();
+  const auto floor = open_.size();
+  while (true) {
+    const auto& token = Peek();
+    switch (token.type) {
+      case Token::Type::kLeftParen:
+      case Token::Type::kLeftBracket:
+      case Token::Type::kLeftBrace:
+      case Token::Type::kQuote:
+      case Token::Type::kBacktick:
+      case Token::Type::kTilde:
+      case Token::Type::kTildeSplice:
+        if (open_.size() - floor >= kMaxNesting) {
+          throw Error(token, "Too deeply nested.");
+        }
+        open_.push_back(Open{token.type, elements_.size()});
+        Advance();
+        continue;
+      default:
+        break;
+    }
+    if (open_.size() > floor && Closes(token)) {
+      Advance();
+      elements_.push_back(Close());
+    } else if (open_.size() > floor && AtEnd()) {
+      switch (open_.back().type) {
+        case Token::Type::kLeftParen:
+          throw Error(token, "Expect ')' after list.");
+        case Token::Type::kLeftBracket:
+          throw Error(token, "Expect ']' at the end of vector.");
+        case Token::Type::kLeftBrace:
+          throw Error(token, "Expect '}' at the end of a map.");
+        default:
+          // A quotation of nothing: the token it quotes is unexpected.
+          elements_.push_back(ParseSimpleExpr());
+      }
+    } else {
+      elements_.push_back(ParseSimpleExpr());
+    }
+    // The expression just parsed completes the quotations around it.
+    while (open_.size() > floor && IsQuotation(open_.back().type)) {
+      elements_.push_back(Close());
+    }
+    if (open_.size() == floor) {
+      auto expr = std::move(elements_.back());
+      elements_.pop_back();
+      return expr;
+    }
   }
 }
 
-Expr Parser::ParseVector() {
-  Vector args;
-  while (!Check(Token::Type::kRightBracket) && !AtEnd()) {
-    args.push_back(ParseExpr());
+bool Parser::Closes(const Token& token) const {
+  const auto& open = open_.back();
+  switch (open.type) {
+    case Token::Type::kLeftParen:
+      return token.type == Token::Type::kRightParen;
+    case Token::Type::kLeftBracket:
+      return token.type == Token::Type::kRightBracket;
+    case Token::Type::kLeftBrace:
+      // A key without a value is an error.
+      return token.type == Token::Type::kRightBrace &&
+             (elements_.size() - open.first) % 2 == 0;
+    default:
+      return false;
   }
-  Consume(Token::Type::kRightBracket, "Expect ']' at the end of vector.");
-  return Expr{std::move(args)};
 }
 
-Expr Parser::ParseList() {
-  List exprs;
-  while (!Check(Token::Type::kRightParen) && !AtEnd()) {
-    exprs.push_back(ParseExpr());
+Expr Parser::Close() {
+  const auto open = open_.back();
+  open_.pop_back();
+  const auto begin = std::next(elements_.begin(), open.first);
+  const auto end = elements_.end();
+  auto erase = defer([this, begin, end]() { elements_.erase(begin, end); });
+  switch (open.type) {
+    case Token::Type::kLeftParen:
+      return Expr{List(std::make_move_iterator(begin),
+                       std::make_move_iterator(end))};
+    case Token::Type::kLeftBracket:
+      return Pool(Expr{Vector(std::make_move_iterator(begin),
+                              std::make_move_iterator(end))});
+    case Token::Type::kLeftBrace: {
+      Map s_map;
+      for (auto it = begin; it != end; it += 2) {
+        s_map.emplace(std::move(*it), std::move(*std::next(it)));
+      }
+      return Pool(Expr{std::move(s_map)});
+    }
+    case Token::Type::kQuote:
+      return Pool(Expr{Quoted(std::move(*begin), Quoted::Kind::kQuote)});
+    case Token::Type::kBacktick:
+      return Expr{Quoted(std::move(*begin), Quoted::Kind::kSyntaxQuote)};
+    case Token::Type::kTilde:
+      return Expr{Quoted(std::move(*begin), Quoted::Kind::kUnquote)};
+    default:
+      return Expr{Quoted(std::move(*begin), Quoted::Kind::kSplice)};
   }
-  Consume(Token::Type::kRightParen, "Expect ')' after list.");
-  return Expr{std::move(exprs)};
 }
 
-Expr Parser::ParseMap() {
-  Map s_map;
-  while (!Check(Token::Type::kRightBrace) && !AtEnd()) {
-    auto key = ParseExpr();
-    auto value = ParseExpr();
-    s_map.emplace(std::move(key), std::move(value));
+Expr Parser::Pool(Expr&& literal) {
+  if (!ConstantPool::IsConstant(literal)) {
+    return std::move(literal);
   }
-  Consume(Token::Type::kRightBrace, "Expect '}' at the end of a map.");
-  return Expr{std::move(s_map)};
+  return constants_.Intern(std::move(literal));
 }
 
 bool Parser::Match(Token::Type type) {
@@ -5,21 +5,27 @@
 
 #include <initializer_list>
 #include <iterator>
-#include <list>
 #include <memory>
 #include <string>
 #include <utility>
 #include <variant>
+#include <vector>
 
 #include "simpl/ast.hh"
+#include "simpl/constant_pool.hh"
 #include "simpl/token.hh"
 
 namespace simpl {
 
-using token_list_t = std::list<Token>;
+using token_list_t = std::vector<Token>;
 
 class Parser {
  public:
+  // The most collections and quotations that may be nested in a form. Forms
+  // are analyzed, and values printed, compared and freed, recursively on the
+  // stack of the thread, so deeper ones could not be used anyway.
+  static constexpr size_t kMaxNesting = 1000;
+
   explicit Parser(token_list_t tokens)
       : tokens_(std::move(tokens)), current_(tokens_.begin()) {}
   ExprList Parse();
@@ -30,12 +36,21 @@ class Parser {
   };
 
  private:
+  // A collection or quotation whose elements are being parsed.
+  struct Open {
+    Token::Type type;  // Of the token that opened it
+    size_t first;      // Of its elements on elements_
+  };
+
   ParseError Error(const Token& token, const std::string& msg);
   Expr ParseSimpleExpr();
   Expr ParseExpr();
-  Expr ParseList();
-  Expr ParseVector();
-  Expr ParseMap();
+  // Whether `token` ends the innermost open collection.
+  bool Closes(const Token& token) const;
+  // Makes the innermost open collection or quotation of its elements.
+  Expr Close();
+  // Returns the pooled copy of a literal that is a constant.
+  Expr Pool(Expr&& literal);
   bool Match(Token::Type type);
   bool Check(Token::Type type) const;
   const Token& Consume(Token::Type type, const std::string& msg);
@@ -45,6 +60,12 @@ class Parser {
   const Token& Previous() const { return *(std::prev(current_)); }
   const token_list_t tokens_;
   token_list_t::const_iterator current_;
+  // What is open, innermost last, and the elements of the collections, so
+  // that parsing does not recurse and nested collections share one buffer
+  // instead of each growing its own.
+  std::vector<Open> open_;
+  std::vector<Expr> elements_;
+  ConstantPool constants_;
 };
 
 }  // namespace simpl
@@ -4,6 +4,8 @@
 
 #include <gtest/gtest.h>
 
+#include <cmath>
+#include <iterator>
 #include <string>
 #include <variant>
 
@@ -31,7 +33,7 @@ TEST(Parser, String) {
   Lexer lexer("\"hello\"");
   auto tokens = lexer.scan();
   EXPECT_EQ(tokens.front().type, Token::kString);
-  EXPECT_EQ(std::get<std::string>(Parse("\"hello\"").front()), "hello");
+  EXPECT_EQ(std::get<String>(Parse("\"hello\"").front()), "hello");
 }
 
 TEST(Parser, Bool) {
@@ -45,14 +47,14 @@ TEST(Parser, Symbol) {
   Lexer lexer("foo");
   auto tokens = lexer.scan();
   EXPECT_EQ(tokens.front().type, Token::kSymbol);
-  EXPECT_EQ(std::get<Symbol>(Parse("foo").front()).name, "foo");
+  EXPECT_EQ(std::get<Symbol>(Parse("foo").front()).name(), "foo");
 }
 
 TEST(Parser, Keyword) {
   Lexer lexer(":foo");
   auto tokens = lexer.scan();
   EXPECT_EQ(tokens.front().type, Token::kKeyword);
-  EXPECT_EQ(std::get<Keyword>(Parse(":foo").front()).name, "foo");
+  EXPECT_EQ(std::get<Keyword>(Parse(":foo").front()).name(), "foo");
 }
 
 TEST(Parser, List) {
@@ -60,7 +62,7 @@ TEST(Parser, List) {
   auto list = std::get<List>(exprs.front());
   EXPECT_EQ(list.size(), 3);
   auto i = list.begin();
-  EXPECT_EQ(std::get<Symbol>(*i).name, "+");
+  EXPECT_EQ(std::get<Symbol>(*i).name(), "+");
   i++;
   EXPECT_EQ(std::get<int_type>(*i), 1);
   i++;
@@ -90,8 +92,8 @@ TEST(Parser, Map) {
   auto m = std::get<Map>(exprs.front());
   EXPECT_EQ(1, exprs.size());
   EXPECT_EQ(2, m.size());
-  EXPECT_EQ(Expr{1}, m[Expr{Keyword{"a"}}]);
-  EXPECT_EQ(Expr{2}, m[Expr{Keyword{"b"}}]);
+  EXPECT_EQ(Expr{1}, m.at(Expr{Keyword{"a"}}));
+  EXPECT_EQ(Expr{2}, m.at(Expr{Keyword{"b"}}));
 }
 
 TEST(Parser, Let) {
@@ -127,14 +129,14 @@ TEST(Parser, Unquote) {
   auto exprs = Parse("~x");
   auto qt = std::get<Quoted>(exprs.front());
   EXPECT_EQ(qt.kind(), Quoted::Kind::kUnquote);
-  EXPECT_EQ(std::get<Symbol>(qt.expr()).name, "x");
+  EXPECT_EQ(std::get<Symbol>(qt.expr()).name(), "x");
 }
 
 TEST(Parser, SpliceUnquote) {
   auto exprs = Parse("~@body");
   auto qt = std::get<Quoted>(exprs.front());
   EXPECT_EQ(qt.kind(), Quoted::Kind::kSplice);
-  EXPECT_EQ(std::get<Symbol>(qt.expr()).name, "body");
+  EXPECT_EQ(std::get<Symbol>(qt.expr()).name(), "body");
 }
 
 TEST(Parser, SyntaxQuoteWithUnquote) {
@@ -145,6 +147,101 @@ TEST(Parser, SyntaxQuoteWithUnquote) {
   EXPECT_EQ(list.size(), 4);
 }
 
+TEST(Parser, NestedLists) {
+  auto exprs = Parse("(a (b (c d) e) f) (g)");
+  ASSERT_EQ(exprs.size(), 2);
+  const auto& outer = std::get<List>(exprs.front());
+  ASSERT_EQ(outer.size(), 3);
+  const auto& middle = std::get<List>(*std::next(outer.begin()));
+  ASSERT_EQ(middle.size(), 3);
+  EXPECT_EQ(std::get<Symbol>(middle.front()).name(), "b");
+  EXPECT_EQ(std::get<List>(*std::next(middle.begin())).size(), 2);
+  EXPECT_EQ(std::get<Symbol>(middle.back()).name(), "e");
+  EXPECT_EQ(std::get<Symbol>(outer.back()).name(), "f");
+  EXPECT_EQ(std::get<List>(exprs.back()).size(), 1);
+}
+
+TEST(Parser, NestedQuotations) {
+  auto exprs = Parse("'`(a ~b ~@[c 'd])");
+  ASSERT_EQ(exprs.size(), 1);
+  const auto& quote = std::get<Quoted>(exprs.front());
+  EXPECT_EQ(quote.kind(), Quoted::Kind::kQuote);
+  const auto& syntax_quote = std::get<Quoted>(quote.expr());
+  EXPECT_EQ(syntax_quote.kind(), Quoted::Kind::kSyntaxQuote);
+  const auto& list = std::get<List>(syntax_quote.expr());
+  ASSERT_EQ(list.size(), 3);
+  EXPECT_EQ(std::get<Quoted>(*std::next(list.begin())).kind(),
+            Quoted::Kind::kUnquote);
+  const auto& splice = std::get<Quoted>(list.back());
+  EXPECT_EQ(splice.kind(), Quoted::Kind::kSplice);
+  EXPECT_EQ(std::get<Vector>(splice.expr()).size(), 2);
+}
+
+TEST(Parser, Errors) {
+  EXPECT_THROW(Parse("(a (b)"), Parser::ParseError);
+  EXPECT_THROW(Parse("[a [b]"), Parser::ParseError);
+  EXPECT_THROW(Parse("{:a 1"), Parser::ParseError);
+  EXPECT_THROW(Parse("{:a}"), Parser::ParseError);
+  EXPECT_THROW(Parse("(a]"), Parser::ParseError);
+  EXPECT_THROW(Parse("a)"), Parser::ParseError);
+  EXPECT_THROW(Parse("(a ')"), Parser::ParseError);
+  EXPECT_THROW(Parse("'"), Parser::ParseError);
+}
+
+// Nesting is parsed without recursion, up to a limit.
+TEST(Parser, DeeplyNestedForms) {
+  const auto depth = Parser::kMaxNesting;
+  auto exprs = Parse(std::string(depth, '[') + std::string(depth, ']'));
+  ASSERT_EQ(exprs.size(), 1);
+  const Expr* expr = &exprs.front();
+  for (size_t i = 1; i < depth; ++i) {
+    expr = &std::get<Vector>(*expr).front();
+  }
+  EXPECT_TRUE(std::get<Vector>(*expr).empty());
+  EXPECT_THROW(Parse(std::string(depth + 1, '(') + std::string(depth + 1, ')')),
+               Parser::ParseError);
+  EXPECT_THROW(Parse(std::string(200000, '\'') + "a"), Parser::ParseError);
+}
+
+TEST(Parser, EqualLiteralsShareStorage) {
+  auto exprs =
+      Parse(R"('(a [1 2]) '(a [1 2]) "a long string" "a long string")");
+  ASSERT_EQ(exprs.size(), 4);
+  auto it = exprs.begin();
+  const auto& first = std::get<Quoted>(*it++);
+  const auto& second = std::get<Quoted>(*it++);
+  EXPECT_EQ(&first.expr(), &second.expr());
+  const auto& s1 = std::get<String>(*it++);
+  const auto& s2 = std::get<String>(*it++);
+  EXPECT_EQ(s1.view().data(), s2.view().data());
+}
+
+// Pooled literals are copied out of the source rather than sliced from it.
+TEST(Parser, StringLiteralsDoNotKeepTheSource) {
+  auto exprs = Parse(R"("a long string" ["another long string"])");
+  EXPECT_FALSE(std::get<String>(exprs.front()).is_slice());
+  const auto& v = std::get<Vector>(exprs.back());
+  EXPECT_FALSE(std::get<String>(v.front()).is_slice());
+}
+
+TEST(Parser, ConstantVectorsShareStorage) {
+  auto exprs = Parse("[1 \"two\" :three] [1 \"two\" :three] [x] [x]");
+  auto it = exprs.begin();
+  const auto& v1 = std::get<Vector>(*it++);
+  const auto& v2 = std::get<Vector>(*it++);
+  EXPECT_EQ(&v1.front(), &v2.front());
+  // Vectors of symbols are code and are never pooled.
+  const auto& v3 = std::get<Vector>(*it++);
+  const auto& v4 = std::get<Vector>(*it++);
+  EXPECT_NE(&v3.front(), &v4.front());
+}
+
+TEST(Parser, PoolingKeepsTheSignOfZero) {
+  auto exprs = Parse("[0.0] [-0.0]");
+  const auto& negative = std::get<Vector>(exprs.back());
+  EXPECT_TRUE(std::signbit(std::get<float_type>(negative.front())));
+}
+
 }  // namespace simpl
 // Local Variables:
 // compile-command : "bazel test //simpl:parser_test"
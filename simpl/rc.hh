@@ -0,0 +1,87 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_RC_HH_
+#define SIMPL_RC_HH_
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "simpl/memory.hh"
+
+namespace simpl {
+
+// Base of objects shared through Rc, which finds Retain and Release by ADL;
+// a type can instead declare its own (see Callable). The count is not
+// atomic: values belong to a single interpreter, which they are charged to.
+template <typename T>
+class RefCounted : public Accounted {
+ public:
+  uint32_t use_count() const { return refs_; }
+
+  friend void Retain(const T* p) { ++p->refs_; }
+  friend void Release(const T* p) {
+    if (--p->refs_ == 0) delete p;
+  }
+
+ protected:
+  RefCounted() { static_assert(Accountable<T>); }
+  RefCounted(const RefCounted&) { static_assert(Accountable<T>); }
+  RefCounted& operator=(const RefCounted&) { return *this; }
+  ~RefCounted() = default;
+
+ private:
+  mutable uint32_t refs_ = 0;
+};
+
+// An intrusive reference-counted pointer, half the size of a shared_ptr.
+template <typename T>
+class Rc {
+ public:
+  Rc() = default;
+  Rc(std::nullptr_t) {}
+  // Shares ownership of `p`, which may already be owned by other Rcs.
+  explicit Rc(T* p) : p_(p) {
+    if (p_) Retain(p_);
+  }
+  template <typename U>
+    requires std::convertible_to<U*, T*>
+  Rc(std::unique_ptr<U>&& p) : Rc(p.release()) {}
+  template <typename U>
+    requires std::convertible_to<U*, T*>
+  Rc(const Rc<U>& other) : Rc(other.get()) {}
+  Rc(const Rc& other) : Rc(other.p_) {}
+  Rc(Rc&& other) noexcept : p_(std::exchange(other.p_, nullptr)) {}
+  ~Rc() {
+    if (p_) Release(p_);
+  }
+
+  Rc& operator=(Rc other) noexcept {
+    std::swap(p_, other.p_);
+    return *this;
+  }
+
+  T* get() const { return p_; }
+  // Gives up ownership without releasing.
+  [[nodiscard]] T* release() { return std::exchange(p_, nullptr); }
+  T& operator*() const { return *p_; }
+  T* operator->() const { return p_; }
+  explicit operator bool() const { return p_ != nullptr; }
+  // Identity, as for shared_ptr.
+  bool operator==(const Rc& other) const { return p_ == other.p_; }
+  bool operator==(std::nullptr_t) const { return p_ == nullptr; }
+
+ private:
+  T* p_ = nullptr;
+};
+
+template <typename T, typename... Args>
+Rc<T> MakeRc(Args&&... args) {
+  return Rc<T>(new T(std::forward<Args>(args)...));
+}
+
+}  // namespace simpl
+
+#endif  // SIMPL_RC_HH_
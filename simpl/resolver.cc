@@ -0,0 +1,294 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#include "simpl/resolver.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "simpl/ast.hh"
+#include "simpl/callable.hh"
+#include "simpl/function.hh"
+#include "simpl/interpreter.hh"
+#include "simpl/overload.hh"
+
+namespace simpl {
+
+namespace {
+
+class Resolver {
+ public:
+  // Starts from the frames of the closure MakeClosure would return.
+  Resolver(const Interpreter::Environment* env, const captures_t& captures)
+      : globals_(env) {
+    if (captures) {
+      std::vector<const Atom*> names;
+      for (const auto& capture : *captures) names.push_back(capture.name);
+      frames_.push_back(std::move(names));
+    } else {
+      for (; env->parent(); env = env->parent()) {
+        frames_.emplace_back(env->names().begin(), env->names().end());
+      }
+      std::reverse(frames_.begin(), frames_.end());
+    }
+  }
+
+  void PushFrame(std::vector<const Atom*>&& names) {
+    frames_.push_back(std::move(names));
+  }
+
+  void PopFrame() { frames_.pop_back(); }
+
+  void Resolve(const Expr& expr) {
+    std::visit(Overload{[this](const Symbol& s) { Annotate(s); },
+                        [this](const List& l) { ResolveList(l); },
+                        [](const auto&) {}},
+               expr);
+  }
+
+  lexical_addresses_t&& addresses() {
+    for (const auto* symbol : ambiguous_) {
+      addresses_[symbol] = {LexicalAddress::kByName, 0};
+    }
+    return std::move(addresses_);
+  }
+
+ private:
+  enum class Form { kStrict, kLet, kDef, kOpaque };
+
+  bool Annotate(const Symbol& symbol) {
+    auto address = Find(symbol.atom);
+    auto [it, first] = seen_.emplace(&symbol, address);
+    if (!first && it->second != address) {
+      ambiguous_.insert(&symbol);
+    }
+    if (address) {
+      addresses_[&symbol] = *address;
+    }
+    return address.has_value();
+  }
+
+  std::optional<LexicalAddress> Find(const Atom* name) const {
+    for (auto frame = frames_.size(); frame-- > 0;) {
+      const auto& names = frames_[frame];
+      for (auto slot = names.size(); slot-- > 0;) {
+        if (names[slot] == name) {
+          return LexicalAddress{frames_.size() - 1 - frame, slot};
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Classifies a call by the global its head is bound to right now. Calls of
+  // globals that are not bound to a callable yet (usually a function that is
+  // defined later or is being defined) are assumed to be strict; if that
+  // turns out to be wrong the caller passes the forms unevaluated after all.
+  Form Classify(const Atom* name) const {
+    const Expr* value = globals_->Find(name);
+    const auto* callable =
+        value ? std::get_if<callable_ptr_t>(value) : nullptr;
+    if (!callable) return Form::kStrict;
+    const Callable* c = callable->get();
+    switch (c->builtin()) {
+      case Callable::Builtin::kIf:
+      case Callable::Builtin::kDo:
+      case Callable::Builtin::kRecur:
+      case Callable::Builtin::kAnd:
+      case Callable::Builtin::kOr:
+        return Form::kStrict;
+      case Callable::Builtin::kLet:
+      case Callable::Builtin::kLoop:
+        return Form::kLet;
+      case Callable::Builtin::kDef:
+        return Form::kDef;
+      default:
+        break;
+    }
+    return c->is_strict() ? Form::kStrict : Form::kOpaque;
+  }
+
+  void ResolveArgs(const List& list) {
+    for (auto it = std::next(list.begin()); it != list.end(); ++it) {
+      Resolve(*it);
+    }
+  }
+
+  void ResolveList(const List& list) {
+    if (list.empty()) return;
+    const auto& head = list.front();
+    if (std::holds_alternative<Keyword>(head)) {
+      ResolveArgs(list);
+      return;
+    }
+    const auto* symbol = std::get_if<Symbol>(&head);
+    if (!symbol) {
+      Resolve(head);
+      ResolveArgs(list);
+      return;
+    }
+    if (Annotate(*symbol)) {
+      ResolveArgs(list);  // speculatively, as for unbound globals
+      return;
+    }
+    switch (Classify(symbol->atom)) {
+      case Form::kStrict:
+        ResolveArgs(list);
+        break;
+      case Form::kLet:
+        ResolveLet(list);
+        break;
+      case Form::kDef:
+        if (list.size() == 3) Resolve(list.back());
+        break;
+      case Form::kOpaque:
+        break;
+    }
+  }
+
+  // Binding values are evaluated in the enclosing environment; only the body
+  // runs in the new frame.
+  void ResolveLet(const List& list) {
+    if (list.size() < 2) return;
+    auto it = std::next(list.begin());
+    const auto* bindings = std::get_if<Vector>(&*it);
+    if (!bindings || bindings->size() % 2 != 0) return;
+    std::vector<const Atom*> names;
+    for (size_t i = 0; i < bindings->size(); i += 2) {
+      const auto* name = std::get_if<Symbol>(&(*bindings)[i]);
+      if (!name) return;
+      names.push_back(name->atom);
+      Resolve((*bindings)[i + 1]);
+    }
+    PushFrame(std::move(names));
+    for (++it; it != list.end(); ++it) {
+      Resolve(*it);
+    }
+    PopFrame();
+  }
+
+  std::vector<std::vector<const Atom*>> frames_;
+  lexical_addresses_t addresses_;
+  // Where each symbol resolved, to catch subforms that appear more than once.
+  std::unordered_map<const Symbol*, std::optional<LexicalAddress>> seen_;
+  std::unordered_set<const Symbol*> ambiguous_;
+  // Any frame will do to Find globals.
+  const Interpreter::Environment* globals_;
+};
+
+// Adds every symbol in `expr` to `symbols`, including quoted ones and those
+// in nested function bodies. Returns false if `expr` calls something that may
+// evaluate symbols it does not contain.
+bool CollectSymbols(const Interpreter::Environment* globals, const Expr& expr,
+                    std::unordered_set<const Atom*>* symbols) {
+  return std::visit(
+      Overload{[&](const Symbol& s) {
+                 symbols->insert(s.atom);
+                 return true;
+               },
+               [&](const List& l) {
+                 if (!l.empty() && std::holds_alternative<Symbol>(l.front())) {
+                   const Expr* value =
+                       globals->Find(std::get<Symbol>(l.front()).atom);
+                   const auto* callable =
+                       value ? std::get_if<callable_ptr_t>(value) : nullptr;
+                   if (callable &&
+                       ((*callable)->kind() == Callable::Kind::kMacro ||
+                        (*callable)->builtin() == Callable::Builtin::kEval)) {
+                     return false;
+                   }
+                 }
+                 return std::all_of(l.begin(), l.end(), [&](const Expr& e) {
+                   return CollectSymbols(globals, e, symbols);
+                 });
+               },
+               [&](const Vector& v) {
+                 return std::all_of(v.begin(), v.end(), [&](const Expr& e) {
+                   return CollectSymbols(globals, e, symbols);
+                 });
+               },
+               [&](const Map& m) {
+                 return std::all_of(m.begin(), m.end(), [&](const auto& kv) {
+                   return CollectSymbols(globals, kv.first, symbols) &&
+                          CollectSymbols(globals, kv.second, symbols);
+                 });
+               },
+               [&](const Quoted& qt) {
+                 return CollectSymbols(globals, qt.expr(), symbols);
+               },
+               [](const auto&) { return true; }},
+      expr);
+}
+
+}  // namespace
+
+lexical_addresses_t ResolveLocals(Interpreter* interpreter,
+                                  const captures_t& captures,
+                                  const std::list<const Atom*>& params,
+                                  const Atom* param_rest,
+                                  const ExprList& body) {
+  Resolver resolver(&interpreter->frame(), captures);
+  std::vector<const Atom*> names(params.begin(), params.end());
+  if (param_rest) names.push_back(param_rest);
+  resolver.PushFrame(std::move(names));
+  for (const auto& expr : body) {
+    resolver.Resolve(expr);
+  }
+  return resolver.addresses();
+}
+
+captures_t FindCaptures(Interpreter* interpreter,
+                        const std::list<const Atom*>& params,
+                        const Atom* param_rest, const ExprList& body) {
+  const auto& env = interpreter->frame();
+  if (!env.parent()) {
+    return std::nullopt;
+  }
+  std::unordered_set<const Atom*> symbols;
+  const auto* globals = interpreter->globals().get();
+  for (const auto& expr : body) {
+    if (!CollectSymbols(globals, expr, &symbols)) {
+      return std::nullopt;
+    }
+  }
+  for (const auto* param : params) symbols.erase(param);
+  if (param_rest) symbols.erase(param_rest);
+
+  std::vector<Capture> captures;
+  captures.reserve(symbols.size());
+  size_t depth = 0;
+  for (const auto* frame = &env; frame->parent();
+       frame = frame->parent(), ++depth) {
+    const auto& names = frame->names();
+    for (auto slot = names.size(); slot-- > 0;) {
+      // Only the innermost binding of a name is visible.
+      if (symbols.erase(names[slot])) {
+        captures.push_back({names[slot], depth, slot});
+      }
+    }
+  }
+  return captures;
+}
+
+std::shared_ptr<Interpreter::Environment> MakeClosure(
+    Interpreter* interpreter, const captures_t& captures) {
+  if (!captures) {
+    return interpreter->env();
+  }
+  auto closure =
+      interpreter->NewEnvironment(interpreter->globals(), captures->size());
+  const auto& env = interpreter->frame();
+  for (const auto& capture : *captures) {
+    closure->Bind(capture.name, env.Get(capture.depth, capture.slot));
+  }
+  return closure;
+}
+
+}  // namespace simpl
@@ -0,0 +1,86 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_RESOLVER_HH_
+#define SIMPL_RESOLVER_HH_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "simpl/ast.hh"
+#include "simpl/interpreter.hh"
+
+namespace simpl {
+
+// An enclosing local that a function body mentions, by its lexical address
+// in the environment the function is created in.
+struct Capture {
+  const Atom* name;
+  size_t depth;
+  size_t slot;
+};
+
+// Empty when a function closes over the whole environment it is created in.
+using captures_t = std::optional<std::vector<Capture>>;
+
+// The lexical address of a local variable: the number of frames to walk up
+// and the slot within that frame.
+struct LexicalAddress {
+  // The depth of a symbol that has to be looked up by name after all.
+  static constexpr size_t kByName = SIZE_MAX;
+
+  bool operator==(const LexicalAddress&) const = default;
+
+  size_t depth;
+  size_t slot;
+};
+
+// The addresses of the local variable references in some code, keyed by the
+// Symbols in the code itself, which is left untouched. Code built at run time
+// can share a subform between places where its symbols mean different
+// things; such symbols are marked kByName.
+using lexical_addresses_t = std::unordered_map<const Symbol*, LexicalAddress>;
+
+// Finds the lexical address of the references to local variables in a
+// function body, relative to a frame holding `params` and then `param_rest`
+// (if not null) whose parent is the closure MakeClosure returns for
+// `captures` in the interpreter's current environment.
+//
+// Only code expected to run in that frame is resolved. Arguments of macros,
+// lazy functions and special forms other than if/do/and/or/let/loop/recur/def,
+// quoted forms, as well as the bodies of nested functions, are left alone,
+// since they may end up being evaluated in another environment; those
+// symbols keep being looked up by name. Arguments of local or not yet bound
+// callees are resolved on the assumption that they are strict functions.
+lexical_addresses_t ResolveLocals(Interpreter* interpreter,
+                                  const captures_t& captures,
+                                  const std::list<const Atom*>& params,
+                                  const Atom* param_rest,
+                                  const ExprList& body);
+
+// Returns what a function with the given parameters and body, defined in the
+// interpreter's current environment, should close over: just the enclosing
+// locals the body mentions. Since bindings are immutable this is
+// indistinguishable from closing over the whole chain, except that the rest
+// of the chain is not kept alive.
+//
+// The analysis is syntactic, so nullopt is returned instead when the body
+// calls a macro or `eval`, which may evaluate symbols that are not written in
+// it. The result only depends on the names bound in the chain and on the
+// globals, so it can be reused while neither changes.
+captures_t FindCaptures(Interpreter* interpreter,
+                        const std::list<const Atom*>& params,
+                        const Atom* param_rest, const ExprList& body);
+
+// Returns the environment to close over according to `captures`: a single
+// frame holding copies of the captured values in order, whose parent is the
+// global environment, or the current environment itself.
+std::shared_ptr<Interpreter::Environment> MakeClosure(
+    Interpreter* interpreter, const captures_t& captures);
+
+}  // namespace simpl
+
+#endif  // SIMPL_RESOLVER_HH_
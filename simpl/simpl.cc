@@ -19,6 +19,7 @@
 #include "simpl/interpreter.hh"
 #include "simpl/lexer.hh"
 #include "simpl/parser.hh"
+#include "simpl/vm/vm.hh"
 #include "simpl_lib/arrows.hh"
 
 namespace simpl {
@@ -36,16 +37,24 @@ std::unique_ptr<Interpreter> InitSimpl() {
   return interpreter;
 }
 
-Expr RunInterpreter(Interpreter *interpreter, std::string &&source) {
+Expr Execute(Interpreter *interpreter, ExprList &&program, Engine engine) {
+  if (engine == Engine::kVM) {
+    return vm::Evaluate(interpreter, program);
+  }
+  return interpreter->Evaluate(std::move(program));
+}
+
+Expr RunInterpreter(Interpreter *interpreter, std::string &&source,
+                    Engine engine) {
   Lexer lexer(std::move(source));
   auto tokens = lexer.scan();
   Parser parser(std::move(tokens));
-  return interpreter->Evaluate(parser.Parse());
+  return Execute(interpreter, parser.Parse(), engine);
 }
 
 }  // anonymous namespace
 
-Expr run(const std::string &source, Timing *timing) {
+Expr run(const std::string &source, Timing *timing, Engine engine) {
   auto t1 = std::chrono::steady_clock::now();
   Lexer lexer(source);
   auto tokens = lexer.scan();  // throws LexError on failure
@@ -54,7 +63,7 @@ Expr run(const std::string &source, Timing *timing) {
   auto ast = parser.Parse();  // throws ParseError on failure
   auto t3 = std::chrono::steady_clock::now();
   auto interpreter = InitSimpl();
-  const auto &result = interpreter->Evaluate(std::move(ast));
+  const auto &result = Execute(interpreter.get(), std::move(ast), engine);
   auto t4 = std::chrono::steady_clock::now();
   if (timing) {
     timing->lexer_ms =
@@ -67,7 +76,7 @@ Expr run(const std::string &source, Timing *timing) {
   return result;
 }
 
-void RunFile(const std::string &path) {
+void RunFile(const std::string &path, Engine engine) {
   std::ifstream file(path);
   if (file) {
     std::ostringstream ss;
@@ -75,7 +84,7 @@ void RunFile(const std::string &path) {
     file.close();
     Timing t;
     try {
-      run(ss.str(), &t);
+      run(ss.str(), &t, engine);
     } catch (const std::runtime_error &e) {
       std::cerr << e.what() << std::endl;
       exit(65);
@@ -89,7 +98,7 @@ void RunFile(const std::string &path) {
   }
 }
 
-void RunREPL() {
+void RunREPL(Engine engine) {
   std::cout << "Simpl " << kVersion << std::endl;
   auto interpreter = InitSimpl();
   while (true) {
@@ -103,7 +112,7 @@ void RunREPL() {
       continue;
     }
     try {
-      std::cout << RunInterpreter(interpreter.get(), std::move(line))
+      std::cout << RunInterpreter(interpreter.get(), std::move(line), engine)
                 << std::endl;
     } catch (const std::runtime_error &e) {
       std::cerr << e.what() << std::endl;
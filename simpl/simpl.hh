@@ -10,15 +10,20 @@
 
 namespace simpl {
 
+// How parsed programs are executed: by walking the AST, or by compiling each
+// top-level form to bytecode for the VM in simpl/vm.
+enum class Engine { kInterpreter, kVM };
+
 struct Timing {
   std::chrono::milliseconds lexer_ms;
   std::chrono::milliseconds parser_ms;
   std::chrono::milliseconds interpreter_ms;
 };
 
-Expr run(const std::string &source, Timing *timing = nullptr);
-void RunREPL();
-void RunFile(const std::string &path);
+Expr run(const std::string &source, Timing *timing = nullptr,
+         Engine engine = Engine::kInterpreter);
+void RunREPL(Engine engine = Engine::kInterpreter);
+void RunFile(const std::string &path, Engine engine = Engine::kInterpreter);
 
 }  // namespace simpl
 
@@ -98,6 +98,11 @@ TEST(SimplTest, ListHead) {
   EXPECT_EQ(std::get<int_type>(e), 1);
 }
 
+TEST(SimplTest, HeadOfEmptyList) {
+  EXPECT_TRUE(holds<std::nullptr_t>(run("(head '())")));
+  EXPECT_TRUE(holds<std::nullptr_t>(run("(head (tail '(1)))")));
+}
+
 TEST(SimplTest, ListTail) {
   auto e = run("(tail '(1 2 3))");
   EXPECT_TRUE(holds<List>(e));
@@ -110,6 +115,11 @@ TEST(SimplTest, VectorHead) {
   EXPECT_EQ(std::get<int_type>(e), 1);
 }
 
+TEST(SimplTest, HeadOfEmptyVector) {
+  EXPECT_TRUE(holds<std::nullptr_t>(run("(head [])")));
+  EXPECT_TRUE(holds<std::nullptr_t>(run("(head (tail [1]))")));
+}
+
 TEST(SimplTest, VectorTail) {
   auto e = run("(tail [1 2 3])");
   EXPECT_TRUE(holds<Vector>(e));
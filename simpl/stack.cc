@@ -0,0 +1,188 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+// macOS declares the ucontext functions only for X/Open, which hides the
+// Darwin extensions unless they are asked for too.
+#if defined(__APPLE__) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600
+#define _DARWIN_C_SOURCE
+#endif
+
+#include "simpl/stack.hh"
+
+#if __has_include(<ucontext.h>)
+#include <ucontext.h>
+#define SIMPL_HAVE_UCONTEXT 1
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define SIMPL_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SIMPL_ASAN 1
+#endif
+#endif
+#ifdef SIMPL_ASAN
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+#include "simpl/memory.hh"
+#include "simpl/util.hh"
+
+namespace simpl {
+
+namespace {
+
+// How much of the thread's own stack evaluation may use, below the point
+// where it first checked for room, and never past what the thread has left
+// (see StackLimit).
+constexpr std::size_t kNativeStackSize = 256 * 1024;
+constexpr std::size_t kSegmentSize = 1024 * 1024;
+// What is left of a segment when the next one is started: enough for the
+// deepest C++ recursion between two checks, such as printing or expanding a
+// nested form.
+constexpr std::size_t kRedZone = 64 * 1024;
+
+// Stacks grow down: a new segment is needed once the stack pointer is below
+// this.
+thread_local std::uintptr_t stack_limit = 0;
+
+// The lowest address of the stack of the calling thread, or 0 if it is not
+// known.
+std::uintptr_t ThreadStackBottom() {
+  void* bottom = nullptr;
+#if defined(__linux__)
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    std::size_t size;
+    if (pthread_attr_getstack(&attr, &bottom, &size) != 0) {
+      bottom = nullptr;
+    }
+    pthread_attr_destroy(&attr);
+  }
+#elif defined(__APPLE__)
+  // The address is that of the top of the stack.
+  bottom = static_cast<char*>(pthread_get_stackaddr_np(pthread_self())) -
+           pthread_get_stacksize_np(pthread_self());
+#endif
+  return reinterpret_cast<std::uintptr_t>(bottom);
+}
+
+// The limit for a thread that first checks for room at `sp`.
+std::uintptr_t StackLimit(std::uintptr_t sp) {
+  std::uintptr_t limit = sp > kNativeStackSize ? sp - kNativeStackSize : 0;
+  if (auto bottom = ThreadStackBottom()) {
+    limit = std::max(limit, bottom + kRedZone);
+  }
+  return limit;
+}
+
+#ifdef SIMPL_HAVE_UCONTEXT
+
+struct Entry {
+  void (*fn)(void*);
+  void* arg;
+  std::exception_ptr error;
+  // The stack of the caller, for AddressSanitizer.
+  const void* caller_bottom = nullptr;
+  std::size_t caller_size = 0;
+};
+
+// The entry of the segment being started, which makecontext cannot pass as
+// an argument.
+thread_local Entry* starting = nullptr;
+
+// AddressSanitizer has to be told about every switch of stacks, or it takes
+// the frames of the other stack for ones that have gone out of scope (see
+// sanitizer/common_interface_defs.h). The switch to `bottom` is started
+// before swapcontext and finished after it, on the new stack.
+void StartSwitch([[maybe_unused]] void** fake_stack,
+                 [[maybe_unused]] const void* bottom,
+                 [[maybe_unused]] std::size_t size) {
+#ifdef SIMPL_ASAN
+  __sanitizer_start_switch_fiber(fake_stack, bottom, size);
+#endif
+}
+
+void FinishSwitch([[maybe_unused]] void* fake_stack,
+                  [[maybe_unused]] const void** bottom_old,
+                  [[maybe_unused]] std::size_t* size_old) {
+#ifdef SIMPL_ASAN
+  __sanitizer_finish_switch_fiber(fake_stack, bottom_old, size_old);
+#endif
+}
+
+void Enter() {
+  Entry* entry = starting;
+  FinishSwitch(nullptr, &entry->caller_bottom, &entry->caller_size);
+  try {
+    entry->fn(entry->arg);
+  } catch (...) {
+    entry->error = std::current_exception();
+  }
+  // Back to the caller through uc_link, for good: the segment is freed.
+  StartSwitch(nullptr, entry->caller_bottom, entry->caller_size);
+}
+
+#endif  // SIMPL_HAVE_UCONTEXT
+
+}  // namespace
+
+bool HasStackRoom() {
+  char here;
+  auto sp = reinterpret_cast<std::uintptr_t>(&here);
+  if (!stack_limit) {
+    stack_limit = StackLimit(sp);
+  }
+  return sp > stack_limit;
+}
+
+#ifdef SIMPL_HAVE_UCONTEXT
+
+void RunOnNewStackSegment(void (*fn)(void*), void* arg) {
+  auto* segment = static_cast<char*>(Allocate(kSegmentSize));
+  auto free_segment =
+      defer([segment]() { Deallocate(segment, kSegmentSize); });
+  Entry entry{fn, arg, nullptr};
+  ucontext_t caller;
+  ucontext_t callee;
+  if (getcontext(&callee) != 0) {
+    throw std::runtime_error("Could not start a new stack segment");
+  }
+  callee.uc_stack.ss_sp = segment;
+  callee.uc_stack.ss_size = kSegmentSize;
+  callee.uc_link = &caller;
+  makecontext(&callee, &Enter, 0);
+  starting = &entry;
+  auto previous_limit = std::exchange(
+      stack_limit, reinterpret_cast<std::uintptr_t>(segment) + kRedZone);
+  // Returns once Enter does.
+  void* fake_stack = nullptr;
+  StartSwitch(&fake_stack, segment, kSegmentSize);
+  swapcontext(&caller, &callee);
+  FinishSwitch(fake_stack, nullptr, nullptr);
+  stack_limit = previous_limit;
+  if (entry.error) {
+    std::rethrow_exception(entry.error);
+  }
+}
+
+#else
+
+// Without ucontext, recursion is bounded by the stack of the thread.
+void RunOnNewStackSegment(void (*)(void*), void*) {
+  throw RecursionDepthError("Out of stack space");
+}
+
+#endif  // SIMPL_HAVE_UCONTEXT
+
+}  // namespace simpl
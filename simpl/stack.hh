@@ -0,0 +1,51 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_STACK_HH_
+#define SIMPL_STACK_HH_
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace simpl {
+
+class RecursionDepthError : public std::runtime_error {
+ public:
+  explicit RecursionDepthError(const std::string& msg)
+      : std::runtime_error(msg) {}
+};
+
+// Evaluation recurses in C++, but only so far on the stack of the thread:
+// past kNativeStackSize bytes, or nearer the end of the thread's stack (see
+// stack.cc), it carries on in segments of a stack allocated from the heap, a
+// new one whenever the current one is nearly full. Recursion is thus bounded
+// by memory, not by the size of the thread's stack. Segments are charged to
+// the current memory account (see memory.hh), so a memory limit applies to
+// them too. Where there is no <ucontext.h> to switch stacks with, running out
+// of the thread's stack throws a RecursionDepthError instead.
+
+// Whether the current stack segment has room for another level of calls.
+bool HasStackRoom();
+
+// Runs `fn(arg)` on a new stack segment, which is freed when it returns.
+// Exceptions are passed on to the caller.
+void RunOnNewStackSegment(void (*fn)(void*), void* arg);
+
+// Returns `fn()`, run on a new stack segment if the current one is nearly
+// full.
+template <typename F>
+auto WithStack(F&& fn) -> decltype(fn()) {
+  if (HasStackRoom()) {
+    return fn();
+  }
+  std::optional<decltype(fn())> result;
+  auto run = [&fn, &result]() { result.emplace(fn()); };
+  using Run = decltype(run);
+  RunOnNewStackSegment([](void* run) { (*static_cast<Run*>(run))(); }, &run);
+  return std::move(*result);
+}
+
+}  // namespace simpl
+
+#endif  // SIMPL_STACK_HH_
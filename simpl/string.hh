@@ -0,0 +1,185 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_STRING_HH_
+#define SIMPL_STRING_HH_
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "simpl/memory.hh"
+
+namespace simpl {
+
+// An immutable string in one word. A string of up to seven bytes is stored
+// in the word itself; a longer one is a reference-counted buffer, so copying
+// a String never copies its bytes, and substr() returns a slice that shares
+// the buffer of the string it is taken from.
+class String {
+ public:
+  using value_type = char;
+  static constexpr std::size_t kInlineSize = sizeof(uintptr_t) - 1;
+
+  String() : word_(kEmpty) {}
+  String(std::string_view s) {  // NOLINT: implicit, like std::string's
+    if (s.size() <= kInlineSize) {
+      SetInline(s);
+    } else {
+      word_ = reinterpret_cast<uintptr_t>(Rep::Make(s));
+    }
+  }
+  String(const std::string& s) : String(std::string_view(s)) {}  // NOLINT
+  String(const char* s) : String(std::string_view(s)) {}         // NOLINT
+  String(const String& other) : word_(other.word_) {
+    if (!is_inline()) Retain(rep());
+  }
+  String(String&& other) noexcept
+      : word_(std::exchange(other.word_, kEmpty)) {}
+  ~String() {
+    if (!is_inline()) Release(rep());
+  }
+
+  String& operator=(String other) noexcept {
+    std::swap(word_, other.word_);
+    return *this;
+  }
+
+  std::string_view view() const {
+    if (is_inline()) {
+      return {reinterpret_cast<const char*>(&word_) + 1,
+              static_cast<std::size_t>((word_ & 0xff) >> 1)};
+    }
+    return {rep()->data, rep()->size};
+  }
+  std::string str() const { return std::string(view()); }
+  operator std::string_view() const { return view(); }  // NOLINT
+  std::size_t size() const { return view().size(); }
+  bool empty() const { return size() == 0; }
+  char front() const { return view().front(); }
+  int compare(const String& other) const {
+    return view().compare(other.view());
+  }
+
+  // A substring in O(1): a short one is copied inline, a longer one is a
+  // slice of this string's buffer, which it keeps alive.
+  String substr(std::size_t pos, std::size_t count = std::string_view::npos)
+      const {
+    auto sub = view().substr(pos, count);
+    if (sub.size() <= kInlineSize) {
+      return String(sub);
+    }
+    const Rep* base = rep()->base ? rep()->base : rep();
+    String slice;
+    slice.word_ = reinterpret_cast<uintptr_t>(Rep::Slice(base, sub));
+    return slice;
+  }
+
+  // Whether this is a slice of the buffer of a longer string.
+  bool is_slice() const { return !is_inline() && rep()->base; }
+  // The string with buffers of its own: a slice is copied, so that it no
+  // longer keeps the whole of the string it was taken from alive.
+  String Compact() const { return is_slice() ? String(view()) : *this; }
+
+  // The hash of the bytes; cached in the buffer of a long string.
+  std::size_t hash() const {
+    if (is_inline()) {
+      return std::hash<std::string_view>{}(view());
+    }
+    if (!rep()->hashed) {
+      rep()->hash = std::hash<std::string_view>{}(view());
+      rep()->hashed = true;
+    }
+    return rep()->hash;
+  }
+
+  bool operator==(const String& other) const {
+    if (word_ == other.word_) {
+      return true;
+    }
+    if (is_inline() || other.is_inline()) {
+      return view() == other.view();
+    }
+    const Rep* a = rep();
+    const Rep* b = other.rep();
+    if (a->size != b->size || (a->hashed && b->hashed && a->hash != b->hash)) {
+      return false;
+    }
+    return view() == other.view();
+  }
+  bool operator==(std::string_view other) const { return view() == other; }
+  bool operator==(const char* other) const { return view() == other; }
+
+ private:
+  static_assert(std::endian::native == std::endian::little,
+                "inline strings overlay the low byte of the word");
+
+  // A long string: a header followed by the bytes, or, for a slice, a
+  // header pointing into the bytes of its base.
+  struct Rep {
+    static const Rep* Make(std::string_view s) {
+      void* memory = Allocate(sizeof(Rep) + s.size());
+      auto* bytes = static_cast<char*>(memory) + sizeof(Rep);
+      std::memcpy(bytes, s.data(), s.size());
+      return new (memory) Rep{bytes, s.size(), nullptr};
+    }
+    static const Rep* Slice(const Rep* base, std::string_view s) {
+      void* memory = Allocate(sizeof(Rep));
+      Retain(base);
+      return new (memory) Rep{s.data(), s.size(), base};
+    }
+
+    friend void Retain(const Rep* rep) { ++rep->refs; }
+    friend void Release(const Rep* rep) {
+      if (--rep->refs != 0) {
+        return;
+      }
+      const Rep* base = rep->base;
+      const std::size_t size = sizeof(Rep) + (base ? 0 : rep->size);
+      rep->~Rep();
+      Deallocate(const_cast<Rep*>(rep), size);
+      if (base) {
+        Release(base);
+      }
+    }
+
+    const char* data;
+    std::size_t size;
+    const Rep* base;  // Owns the bytes of a slice.
+    mutable std::size_t hash = 0;
+    mutable bool hashed = false;
+    mutable uint32_t refs = 1;
+  };
+
+  // The low bit tells the two representations apart: Reps are aligned, and
+  // an inline string keeps its size shifted left by one in the low byte.
+  static constexpr uintptr_t kEmpty = 1;
+
+  bool is_inline() const { return word_ & 1; }
+  const Rep* rep() const { return reinterpret_cast<const Rep*>(word_); }
+  void SetInline(std::string_view s) {
+    word_ = (s.size() << 1) | 1;
+    std::memcpy(reinterpret_cast<char*>(&word_) + 1, s.data(), s.size());
+  }
+
+  uintptr_t word_;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const String& s) {
+  return os << s.view();
+}
+
+}  // namespace simpl
+
+template <>
+struct std::hash<simpl::String> {
+  std::size_t operator()(const simpl::String& s) const { return s.hash(); }
+};
+
+#endif  // SIMPL_STRING_HH_
@@ -4,9 +4,12 @@
 #define SIMPL_TOKEN_HH_
 
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 
 #include "simpl/config.hh"
+#include "simpl/string.hh"
 
 namespace simpl {
 
@@ -54,17 +57,17 @@ class Token {
     kEof
   };
 
-  using literal_t =
-      std::variant<int_type, float_type, std::string, std::nullptr_t>;
+  // String literals and keyword names are slices of the source.
+  using literal_t = std::variant<int_type, float_type, String, std::nullptr_t>;
   const Type type;
-  const std::string lexeme;
+  const std::string_view lexeme;  // Into the source of the Lexer
   const literal_t literal;
   const size_t line;
 
-  Token(Type type, const std::string &lexeme, literal_t literal, size_t line)
-      : type(type), lexeme(lexeme), literal(literal), line(line) {}
+  Token(Type type, std::string_view lexeme, literal_t literal, size_t line)
+      : type(type), lexeme(lexeme), literal(std::move(literal)), line(line) {}
 
-  explicit operator std::string() const { return lexeme; }
+  explicit operator std::string() const { return std::string(lexeme); }
 };
 
 }  // namespace simpl
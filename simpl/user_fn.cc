@@ -2,7 +2,11 @@
 
 #include "simpl/user_fn.hh"
 
+#include <iterator>
 #include <memory>
+#include <stdexcept>
+#include <utility>
+#include <variant>
 
 #include "simpl/ast.hh"
 #include "simpl/interpreter.hh"
@@ -10,15 +14,58 @@
 namespace simpl {
 
 Expr UserFn::FnCall(Interpreter* interpreter, Function::args_type&& args) {
-  auto env = make_shared<Interpreter::Environment>(closure_);
+  CheckArgs(args);
+  return interpreter->Nest([this, interpreter, &args]() {
+    auto env =
+        interpreter->NewFrame(closure_, definition_->params().size() + 1);
+    auto arg = args.begin();
+    for (const auto& param : definition_->params()) {
+      env->Bind(param, std::move(*arg++));
+    }
+    if (definition_->param_rest()) {
+      env->Bind(definition_->param_rest(),
+                List(std::make_move_iterator(arg),
+                     std::make_move_iterator(args.end())));
+    }
+    for (;;) {
+      auto result = interpreter->Execute(definition_->code(), env);
+      // A tail call of this same function runs in this frame again, with the
+      // new arguments bound to its slots, unless something made in the call
+      // still refers to the frame. Any other result goes to the trampoline.
+      auto* tc = std::get_if<TailCall>(&result);
+      if (!tc || tc->callable().get() != this || env.use_count() != 1) {
+        interpreter->ReleaseFrame(std::move(env));
+        return result;
+      }
+      Rebind(env.get(), std::move(tc->args()));
+    }
+  });
+}
+
+void UserFn::CheckArgs(const args_type& args) const {
+  // Extra arguments are ignored, as in the VM.
+  if (args.size() < definition_->params().size()) {
+    throw std::runtime_error("Wrong number of arguments to <fn>");
+  }
+}
+
+void UserFn::Rebind(Interpreter::Environment* env, args_type&& args) const {
+  CheckArgs(args);
+  size_t slot = 0;
   auto arg = args.begin();
-  for (const auto& param : definition_.params()) {
-    env->Bind(param, *arg++);
+  for (auto n = definition_->params().size(); slot < n; ++slot) {
+    env->Rebind(slot, std::move(*arg++));
+  }
+  if (definition_->param_rest()) {
+    env->Rebind(slot, List(std::make_move_iterator(arg),
+                           std::make_move_iterator(args.end())));
   }
-  if (!definition_.param_rest().empty()) {
-    env->Bind(definition_.param_rest(), List(arg, args.end()));
+}
+
+void UserFn::Trace(Tracer& tracer) const {
+  if (closure_) {
+    tracer.Visit(closure_.get());
   }
-  return interpreter->EvaluateBody(definition_.body(), env);
 }
 
 }  // namespace simpl
@@ -8,42 +8,72 @@
 #include <string>
 #include <utility>
 
+#include "simpl/analyzer.hh"
 #include "simpl/ast.hh"
 #include "simpl/function.hh"
 #include "simpl/interpreter.hh"
+#include "simpl/resolver.hh"
 
 namespace simpl {
 
+// The code of a function: built once per function form and shared, never
+// modified, by all the functions created from it.
 class FnDef {
  public:
-  using param_list_t = std::list<std::string>;
+  using param_list_t = std::list<const Atom*>;
   using body_t = ExprList;
-  FnDef(param_list_t&& params, body_t&& body, std::string&& param_rest = "")
+  FnDef(param_list_t&& params, body_t&& body, const Atom* param_rest,
+        Body&& code, captures_t&& captures)
       : params_(std::move(params)),
-        param_rest_(std::move(param_rest)),
-        body_(std::move(body)) {}
+        param_rest_(param_rest),
+        body_(std::move(body)),
+        code_(std::move(code)),
+        captures_(std::move(captures)) {}
   virtual ~FnDef() = default;
   const param_list_t& params() const { return params_; }
-  const std::string& param_rest() const { return param_rest_; }
+  // The name bound to the remaining arguments, or nullptr.
+  const Atom* param_rest() const { return param_rest_; }
   const body_t& body() const { return body_; }
+  // The body analyzed for execution.
+  const Body& code() const { return code_; }
+  // The enclosing locals to close over (see FindCaptures).
+  const captures_t& captures() const { return captures_; }
 
  private:
   const param_list_t params_;
-  const std::string param_rest_;
-  body_t body_;
+  const Atom* const param_rest_;
+  const body_t body_;
+  const Body code_;
+  const captures_t captures_;
 };
 
+using fn_def_ptr_t = std::shared_ptr<const FnDef>;
+
 class UserFn : public Function {
  public:
-  explicit UserFn(FnDef&& definition,
+  explicit UserFn(fn_def_ptr_t definition,
                   std::shared_ptr<Interpreter::Environment> closure = nullptr,
                   bool lazy = false)
-      : Function(lazy), definition_(definition), closure_(closure) {}
+      : UserFn(std::move(definition), std::move(closure),
+               lazy ? Kind::kLazyFn : Kind::kUserFn) {}
+
+ protected:
+  UserFn(fn_def_ptr_t definition,
+         std::shared_ptr<Interpreter::Environment> closure, Kind kind)
+      : Function(kind),
+        definition_(std::move(definition)),
+        closure_(std::move(closure)) {}
 
  private:
   Expr FnCall(Interpreter*, args_type&& args) override;
-  FnDef definition_;
-  std::shared_ptr<Interpreter::Environment> closure_;
+  // Throws unless there are enough arguments for the parameters.
+  void CheckArgs(const args_type& args) const;
+  // Binds the arguments of a self tail call to the slots of `env`, the frame
+  // of the call being replaced.
+  void Rebind(Interpreter::Environment* env, args_type&& args) const;
+  void Trace(Tracer& tracer) const override;
+  const fn_def_ptr_t definition_;
+  const std::shared_ptr<Interpreter::Environment> closure_;
 };
 
 }  // namespace simpl
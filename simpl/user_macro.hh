@@ -10,14 +10,14 @@
 
 namespace simpl {
 
-// A macro is a UserFn that always receives unevaluated args (lazy=true).
+// A macro is a UserFn that always receives unevaluated args (it is lazy).
 // Its result is re-evaluated by the interpreter at the call site.
 class UserMacro : public UserFn {
  public:
   explicit UserMacro(
-      FnDef&& definition,
+      fn_def_ptr_t definition,
       std::shared_ptr<Interpreter::Environment> closure = nullptr)
-      : UserFn(std::move(definition), closure, /*lazy=*/true) {}
+      : UserFn(std::move(definition), closure, Kind::kMacro) {}
 };
 
 }  // namespace simpl
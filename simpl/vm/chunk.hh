@@ -0,0 +1,81 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_VM_CHUNK_HH_
+#define SIMPL_VM_CHUNK_HH_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "simpl/ast.hh"
+#include "simpl/vm/opcode.hh"
+
+namespace simpl {
+namespace vm {
+
+struct Instruction {
+  OpCode op;
+  int32_t a = 0;
+  int32_t b = 0;
+};
+
+// A global variable referenced by a chunk. `cell` caches the address of the
+// binding in the global environment once it has been looked up.
+struct GlobalRef {
+  const Atom* name;
+  const Expr* cell = nullptr;
+};
+
+// Where a new closure takes a captured value from: a slot of the enclosing
+// frame or one of the enclosing closure's own captures.
+struct Capture {
+  bool from_local;
+  int32_t index;
+};
+
+// A variable visible at some point in a chunk. Used to rebuild a name-keyed
+// environment when a form has to be handed to the tree-walking interpreter.
+struct ScopeEntry {
+  const Atom* name;
+  bool captured;
+  int32_t index;
+};
+
+using Scope = std::vector<ScopeEntry>;
+
+// A call form that is evaluated by the interpreter when its callee turns out
+// to take unevaluated arguments (lazy functions, macros, special forms).
+struct Fallback {
+  List form;
+  int32_t scope;
+};
+
+// Code compiled for the callable a global was bound to at compile time, which
+// is valid as long as the global still is.
+struct Guard {
+  int32_t global;
+  callable_ptr_t callable;
+};
+
+// Compiled code of one function or top-level form.
+struct Chunk {
+  std::string name;
+  std::vector<Instruction> code;
+  std::vector<Expr> constants;
+  std::vector<GlobalRef> globals;
+  std::vector<std::shared_ptr<Chunk>> functions;
+  std::vector<Capture> captures;
+  std::vector<Scope> scopes;
+  std::vector<Fallback> fallbacks;
+  std::vector<Guard> guards;
+  int32_t num_params = 0;
+  int32_t num_slots = 0;
+  bool has_rest = false;
+  bool lazy = false;
+};
+
+}  // namespace vm
+}  // namespace simpl
+
+#endif  // SIMPL_VM_CHUNK_HH_
@@ -0,0 +1,583 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#include "simpl/vm/compiler.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+
+#include "simpl/ast.hh"
+#include "simpl/built_in/fn.hh"
+#include "simpl/callable.hh"
+#include "simpl/function.hh"
+#include "simpl/overload.hh"
+#include "simpl/util.hh"
+
+namespace simpl {
+namespace vm {
+
+namespace {
+
+std::optional<OpCode> BinaryOpFor(const Callable* callable) {
+  switch (callable->builtin()) {
+    case Callable::Builtin::kSum:
+      return OpCode::kAdd;
+    case Callable::Builtin::kSubtract:
+      return OpCode::kSubtract;
+    case Callable::Builtin::kMultiply:
+      return OpCode::kMultiply;
+    case Callable::Builtin::kEquals:
+      return OpCode::kEqual;
+    case Callable::Builtin::kLessThan:
+      return OpCode::kLess;
+    case Callable::Builtin::kLessThanOrEqualTo:
+      return OpCode::kLessEqual;
+    case Callable::Builtin::kGreaterThan:
+      return OpCode::kGreater;
+    case Callable::Builtin::kGreaterThanOrEqualTo:
+      return OpCode::kGreaterEqual;
+    default:
+      return std::nullopt;
+  }
+}
+
+void CollectSymbols(const Expr& expr, std::set<const Atom*>* names) {
+  std::visit(Overload{[&](const Symbol& s) { names->insert(s.atom); },
+                      [&](const List& l) {
+                        for (const auto& e : l) CollectSymbols(e, names);
+                      },
+                      [&](const Vector& v) {
+                        for (const auto& e : v) CollectSymbols(e, names);
+                      },
+                      [&](const Map& m) {
+                        for (const auto& [k, v] : m) {
+                          CollectSymbols(k, names);
+                          CollectSymbols(v, names);
+                        }
+                      },
+                      [&](const Quoted& qt) { CollectSymbols(qt.expr(), names); },
+                      [](const auto&) {}},
+             expr);
+}
+
+bool HasUnquote(const Expr& expr) {
+  if (const auto* qt = std::get_if<Quoted>(&expr)) {
+    return qt->kind() == Quoted::Kind::kUnquote ||
+           qt->kind() == Quoted::Kind::kSplice;
+  }
+  if (const auto* l = std::get_if<List>(&expr)) {
+    return std::any_of(l->begin(), l->end(), HasUnquote);
+  }
+  return false;
+}
+
+const Atom* SymbolName(const Expr& expr, const std::string& context) {
+  const auto* symbol = std::get_if<Symbol>(&expr);
+  if (!symbol) {
+    throw std::runtime_error(context + ": expected a symbol");
+  }
+  return symbol->atom;
+}
+
+}  // namespace
+
+std::shared_ptr<Chunk> Compiler::CompileTopLevel(const Expr& form) {
+  FunctionState top(nullptr, std::make_shared<Chunk>());
+  top.chunk->name = "<top-level>";
+  state_ = &top;
+  auto restore = defer([this]() { state_ = nullptr; });
+  Compile(form, false);
+  Emit(OpCode::kReturn);
+  return top.chunk;
+}
+
+int32_t Compiler::Emit(OpCode op, int32_t a, int32_t b) {
+  chunk().code.push_back(Instruction{op, a, b});
+  return Here() - 1;
+}
+
+int32_t Compiler::Here() const {
+  return static_cast<int32_t>(state_->chunk->code.size());
+}
+
+void Compiler::PatchA(int32_t at, int32_t target) {
+  chunk().code[at].a = target;
+}
+
+void Compiler::PatchB(int32_t at, int32_t target) {
+  chunk().code[at].b = target;
+}
+
+int32_t Compiler::AddConstant(Expr value) {
+  chunk().constants.push_back(std::move(value));
+  return static_cast<int32_t>(chunk().constants.size() - 1);
+}
+
+int32_t Compiler::AddGlobal(const Atom* name) {
+  auto& globals = chunk().globals;
+  auto it = std::find_if(globals.begin(), globals.end(),
+                         [&](const GlobalRef& g) { return g.name == name; });
+  if (it != globals.end()) {
+    return static_cast<int32_t>(it - globals.begin());
+  }
+  globals.push_back(GlobalRef{name});
+  return static_cast<int32_t>(globals.size() - 1);
+}
+
+int32_t Compiler::AddGuard(const Atom* name, callable_ptr_t callable) {
+  chunk().guards.push_back(Guard{AddGlobal(name), std::move(callable)});
+  return static_cast<int32_t>(chunk().guards.size() - 1);
+}
+
+int32_t Compiler::DeclareLocal(const Atom* name) {
+  int32_t slot = state_->next_slot++;
+  state_->locals.push_back(Local{name, slot});
+  chunk().num_slots = std::max(chunk().num_slots, state_->next_slot);
+  return slot;
+}
+
+bool Compiler::IsLocal(const Atom* name) const {
+  for (auto* state = state_; state; state = state->enclosing) {
+    for (const auto& local : state->locals) {
+      if (local.name == name) return true;
+    }
+    for (const auto& captured : state->capture_names) {
+      if (captured == name) return true;
+    }
+  }
+  return false;
+}
+
+Compiler::Resolved Compiler::Resolve(FunctionState* state,
+                                     const Atom* name) {
+  for (auto it = state->locals.rbegin(); it != state->locals.rend(); ++it) {
+    if (it->name == name) return Resolved{VarKind::kLocal, it->slot};
+  }
+  auto& names = state->capture_names;
+  auto captured = std::find(names.begin(), names.end(), name);
+  if (captured != names.end()) {
+    return Resolved{VarKind::kCapture,
+                    static_cast<int32_t>(captured - names.begin())};
+  }
+  if (state->enclosing) {
+    auto outer = Resolve(state->enclosing, name);
+    if (outer.kind != VarKind::kGlobal) {
+      state->chunk->captures.push_back(
+          Capture{outer.kind == VarKind::kLocal, outer.index});
+      names.push_back(name);
+      return Resolved{VarKind::kCapture,
+                      static_cast<int32_t>(names.size() - 1)};
+    }
+  }
+  return Resolved{VarKind::kGlobal, 0};
+}
+
+// Builds the scope needed to evaluate `form` with the interpreter: the local
+// variables it mentions, or every visible local if `form` is null (for
+// `eval`, whose argument is only known at run time).
+int32_t Compiler::CaptureScope(const Expr* form) {
+  std::set<const Atom*> names;
+  if (form) {
+    CollectSymbols(*form, &names);
+  } else {
+    for (auto* state = state_; state; state = state->enclosing) {
+      for (const auto& local : state->locals) names.insert(local.name);
+      for (const auto& captured : state->capture_names) names.insert(captured);
+    }
+  }
+  Scope scope;
+  for (const auto& name : names) {
+    auto resolved = Resolve(state_, name);
+    if (resolved.kind != VarKind::kGlobal) {
+      scope.push_back(ScopeEntry{name, resolved.kind == VarKind::kCapture,
+                                 resolved.index});
+    }
+  }
+  chunk().scopes.push_back(std::move(scope));
+  return static_cast<int32_t>(chunk().scopes.size() - 1);
+}
+
+const Expr* Compiler::GlobalValue(const Atom* name) {
+  return interpreter_->globals()->Find(name);
+}
+
+void Compiler::Compile(const Expr& expr, bool tail) {
+  std::visit(Overload{[&](const Symbol& s) { CompileSymbol(s); },
+                      [&](const List& l) { CompileList(l, tail); },
+                      [&](const Quoted& qt) { CompileQuoted(qt, tail); },
+                      [&](const auto&) { Emit(OpCode::kConst, AddConstant(expr)); }},
+             expr);
+}
+
+void Compiler::CompileSymbol(const Symbol& symbol) {
+  auto resolved = Resolve(state_, symbol.atom);
+  switch (resolved.kind) {
+    case VarKind::kLocal:
+      Emit(OpCode::kLoadLocal, resolved.index);
+      break;
+    case VarKind::kCapture:
+      Emit(OpCode::kLoadCapture, resolved.index);
+      break;
+    case VarKind::kGlobal:
+      Emit(OpCode::kLoadGlobal, AddGlobal(symbol.atom));
+      break;
+  }
+}
+
+void Compiler::CompileQuoted(const Quoted& quoted, bool tail) {
+  switch (quoted.kind()) {
+    case Quoted::Kind::kQuote:
+      Emit(OpCode::kConst, AddConstant(quoted.expr()));
+      break;
+    case Quoted::Kind::kSyntaxQuote:
+      CompileSyntaxQuote(quoted.expr());
+      break;
+    case Quoted::Kind::kUnquote:
+      Compile(quoted.expr(), tail);
+      break;
+    case Quoted::Kind::kSplice:
+      throw std::runtime_error("~@ used outside of syntax-quote");
+  }
+}
+
+// Mirrors ProcessSyntaxQuote in the interpreter: lists are rebuilt with their
+// unquoted elements evaluated, everything else is a constant.
+void Compiler::CompileSyntaxQuote(const Expr& expr) {
+  if (!HasUnquote(expr)) {
+    Emit(OpCode::kConst, AddConstant(expr));
+    return;
+  }
+  if (const auto* qt = std::get_if<Quoted>(&expr)) {
+    if (qt->kind() == Quoted::Kind::kSplice) {
+      throw std::runtime_error("~@ used outside of a list");
+    }
+    Compile(qt->expr(), false);
+    return;
+  }
+  Emit(OpCode::kNewList);
+  for (const auto& elem : std::get<List>(expr)) {
+    const auto* qt = std::get_if<Quoted>(&elem);
+    if (qt && qt->kind() == Quoted::Kind::kSplice) {
+      Compile(qt->expr(), false);
+      Emit(OpCode::kListSplice);
+    } else {
+      CompileSyntaxQuote(elem);
+      Emit(OpCode::kListAppend);
+    }
+  }
+  Emit(OpCode::kListEnd);
+}
+
+void Compiler::CompileList(const List& list, bool tail) {
+  if (list.empty()) {
+    Emit(OpCode::kConst, AddConstant(Expr{nullptr}));
+    return;
+  }
+  const Expr& head = list.front();
+  if (std::holds_alternative<Keyword>(head)) {
+    if (list.size() != 2) {
+      throw std::runtime_error("Keyword expects 1 argument.");
+    }
+    Compile(list.back(), false);
+    Emit(OpCode::kGetKeyword, AddConstant(head));
+    return;
+  }
+  const auto* symbol = std::get_if<Symbol>(&head);
+  const Expr* global =
+      symbol && !IsLocal(symbol->atom) ? GlobalValue(symbol->atom) : nullptr;
+  const auto* callable_ptr =
+      global ? std::get_if<callable_ptr_t>(global) : nullptr;
+  if (!callable_ptr) {
+    CompileCall(list, tail);
+    return;
+  }
+  const Callable* callable = callable_ptr->get();
+  if (auto op = BinaryOpFor(callable); op && list.size() == 3) {
+    auto it = std::next(list.begin());
+    Compile(*it++, false);
+    Compile(*it, false);
+    Emit(*op, AddGlobal(symbol->atom), AddConstant(*global));
+    return;
+  }
+  // Code compiled for what the head is bound to now: a macro expansion or a
+  // special form. Should the head be rebound, the form is left to the
+  // interpreter instead, as it would be if it had not been compiled.
+  auto guarded = [&](auto&& compile) {
+    auto guard = Emit(OpCode::kGuard, AddGuard(symbol->atom, *callable_ptr));
+    compile();
+    auto to_end = Emit(OpCode::kJump);
+    PatchB(guard, Here());
+    CompileInterpret(list);
+    PatchA(to_end, Here());
+  };
+  if (callable->kind() == Callable::Kind::kMacro) {
+    guarded([&]() {
+      ExprList args(std::next(list.begin()), list.end());
+      auto expanded = interpreter_->Trampoline(
+          (*callable_ptr)->Call(interpreter_, std::move(args)));
+      Compile(expanded, tail);
+    });
+    return;
+  }
+  switch (callable->builtin()) {
+    case Callable::Builtin::kIf:
+      guarded([&]() { CompileIf(list, tail); });
+      return;
+    case Callable::Builtin::kLet:
+      guarded([&]() { CompileLet(list, tail); });
+      return;
+    case Callable::Builtin::kLoop:
+      guarded([&]() { CompileLoop(list, tail); });
+      return;
+    case Callable::Builtin::kRecur:
+      guarded([&]() { CompileRecur(list, tail); });
+      return;
+    case Callable::Builtin::kFn: {
+      const auto* fn = static_cast<const built_in::Fn*>(callable);
+      guarded([&]() {
+        CompileFn(std::next(list.begin()), list.end(), fn->lazy(), nullptr);
+      });
+      return;
+    }
+    case Callable::Builtin::kDef:
+      guarded([&]() { CompileDef(list); });
+      return;
+    case Callable::Builtin::kDefn:
+      guarded([&]() { CompileDefn(list); });
+      return;
+    case Callable::Builtin::kAnd:
+      guarded([&]() { CompileLogic(list, true, tail); });
+      return;
+    case Callable::Builtin::kOr:
+      guarded([&]() { CompileLogic(list, false, tail); });
+      return;
+    case Callable::Builtin::kDo:
+      guarded(
+          [&]() { CompileBody(std::next(list.begin()), list.end(), tail); });
+      return;
+    case Callable::Builtin::kEval:
+      if (list.size() == 2) {
+        guarded([&]() {
+          Compile(list.back(), false);
+          Emit(OpCode::kEval, CaptureScope(nullptr));
+        });
+        return;
+      }
+      break;
+    default:
+      break;
+  }
+  if (callable->kind() == Callable::Kind::kSpecialForm) {
+    CompileInterpret(list);
+  } else {
+    CompileCall(list, tail);
+  }
+}
+
+void Compiler::CompileBody(List::const_iterator begin, List::const_iterator end,
+                           bool tail) {
+  if (begin == end) {
+    Emit(OpCode::kConst, AddConstant(Expr{nullptr}));
+    return;
+  }
+  for (auto it = begin; it != end;) {
+    auto next = std::next(it);
+    Compile(*it, tail && next == end);
+    if (next != end) Emit(OpCode::kPop);
+    it = next;
+  }
+}
+
+void Compiler::CompileIf(const List& list, bool tail) {
+  if (list.size() != 4) {
+    throw std::runtime_error("'if' expects three arguments");
+  }
+  auto it = std::next(list.begin());
+  Compile(*it++, false);
+  auto to_else = Emit(OpCode::kJumpIfFalse);
+  Compile(*it++, tail);
+  auto to_end = Emit(OpCode::kJump);
+  PatchA(to_else, Here());
+  Compile(*it, tail);
+  PatchA(to_end, Here());
+}
+
+void Compiler::CompileLet(const List& list, bool tail) {
+  auto mark = state_->locals.size();
+  auto next_slot = state_->next_slot;
+  CompileBindings(list, "let");
+  CompileBody(std::next(list.begin(), 2), list.end(), tail);
+  state_->locals.resize(mark);
+  state_->next_slot = next_slot;
+}
+
+// Stores the values of the binding vector of a let or a loop form in new
+// locals, and returns their slots.
+std::vector<int32_t> Compiler::CompileBindings(const List& list,
+                                               const std::string& form) {
+  auto it = std::next(list.begin());
+  const Vector* bindings =
+      it != list.end() ? std::get_if<Vector>(&*it) : nullptr;
+  if (!bindings) {
+    throw std::runtime_error("`" + form + "` expects a binding vector.");
+  }
+  if (bindings->size() % 2 != 0) {
+    throw std::runtime_error(
+        "The number of expressions in the binding list must be even.");
+  }
+  // Like the interpreter, evaluates every value in the enclosing scope
+  // before binding any of the names.
+  std::vector<const Atom*> names;
+  for (auto b = bindings->begin(); b != bindings->end();) {
+    names.push_back(SymbolName(*b++, form));
+    Compile(*b++, false);
+  }
+  std::vector<int32_t> slots;
+  for (const auto* name : names) {
+    slots.push_back(DeclareLocal(name));
+  }
+  for (auto slot = slots.rbegin(); slot != slots.rend(); ++slot) {
+    Emit(OpCode::kStoreLocal, *slot);
+  }
+  return slots;
+}
+
+// The body is compiled as a tail, where a recur stores its values in the
+// slots of the loop and jumps back. Closures copy what they capture, so the
+// slots can be reused. Calls in the tail of the body are tail calls only if
+// the loop is in the tail position of the function.
+void Compiler::CompileLoop(const List& list, bool tail) {
+  auto mark = state_->locals.size();
+  auto next_slot = state_->next_slot;
+  Loop loop{CompileBindings(list, "loop"), Here(),
+            tail && (!state_->loop || state_->loop->tail)};
+  auto* enclosing = std::exchange(state_->loop, &loop);
+  auto restore = defer([this, enclosing]() { state_->loop = enclosing; });
+  CompileBody(std::next(list.begin(), 2), list.end(), true);
+  state_->locals.resize(mark);
+  state_->next_slot = next_slot;
+}
+
+void Compiler::CompileRecur(const List& list, bool tail) {
+  const auto* loop = state_->loop;
+  if (!tail || !loop) {
+    // Left to the interpreter, which reports the error when it is run.
+    CompileInterpret(list);
+    return;
+  }
+  if (list.size() - 1 != loop->slots.size()) {
+    throw std::runtime_error("recur expects " +
+                             std::to_string(loop->slots.size()) +
+                             " arguments, got " +
+                             std::to_string(list.size() - 1));
+  }
+  for (auto it = std::next(list.begin()); it != list.end(); ++it) {
+    Compile(*it, false);
+  }
+  for (auto slot = loop->slots.rbegin(); slot != loop->slots.rend(); ++slot) {
+    Emit(OpCode::kStoreLocal, *slot);
+  }
+  Emit(OpCode::kJump, loop->start);
+}
+
+void Compiler::CompileFn(List::const_iterator begin, List::const_iterator end,
+                         bool lazy, const Atom* name) {
+  if (begin == end) {
+    throw std::runtime_error("fn: missing arguments");
+  }
+  const auto* params = std::get_if<Vector>(&*begin);
+  if (!params) {
+    throw std::runtime_error("fn: parameters must be a vector");
+  }
+  FunctionState fn(state_, std::make_shared<Chunk>());
+  fn.chunk->name = name ? name->name : "<fn>";
+  fn.chunk->lazy = lazy;
+  state_ = &fn;
+  auto restore = defer([this, &fn]() { state_ = fn.enclosing; });
+  for (auto p = params->begin(); p != params->end(); ++p) {
+    const auto* param = SymbolName(*p, "fn");
+    if (param->name == "&") {
+      if (std::next(p) == params->end()) {
+        throw std::runtime_error("fn: missing name after &");
+      }
+      fn.chunk->has_rest = true;
+      DeclareLocal(SymbolName(*std::next(p), "fn"));
+      break;
+    }
+    DeclareLocal(param);
+    ++fn.chunk->num_params;
+  }
+  CompileBody(std::next(begin), end, true);
+  Emit(OpCode::kReturn);
+  state_ = fn.enclosing;
+  chunk().functions.push_back(fn.chunk);
+  Emit(OpCode::kClosure, static_cast<int32_t>(chunk().functions.size() - 1));
+}
+
+void Compiler::CompileDef(const List& list) {
+  if (list.size() != 3) {
+    throw std::runtime_error("`def` expects 2 arguments.");
+  }
+  const auto* name = SymbolName(*std::next(list.begin()), "def");
+  Compile(list.back(), false);
+  Emit(OpCode::kDefGlobal, AddGlobal(name));
+}
+
+void Compiler::CompileDefn(const List& list) {
+  if (list.size() < 3) {
+    throw std::runtime_error("`defn` expects at least 2 arguments.");
+  }
+  auto it = std::next(list.begin());
+  const auto* name = SymbolName(*it, "defn");
+  CompileFn(std::next(it), list.end(), false, name);
+  Emit(OpCode::kDefGlobal, AddGlobal(name));
+}
+
+// `and` yields the first falsy operand and `or` the first truthy one;
+// otherwise both yield their last operand.
+void Compiler::CompileLogic(const List& list, bool is_and, bool tail) {
+  if (list.size() == 1) {
+    Emit(OpCode::kConst, AddConstant(Expr{is_and}));
+    return;
+  }
+  std::vector<int32_t> to_end;
+  auto last = std::next(list.begin(), list.size() - 1);
+  for (auto it = std::next(list.begin()); it != last; ++it) {
+    Compile(*it, false);
+    to_end.push_back(Emit(is_and ? OpCode::kJumpIfFalseKeep
+                                 : OpCode::kJumpIfTrueKeep));
+  }
+  Compile(*last, tail);
+  for (auto at : to_end) PatchA(at, Here());
+}
+
+void Compiler::CompileInterpret(const List& list) {
+  Expr form{list};
+  chunk().fallbacks.push_back(Fallback{list, CaptureScope(&form)});
+  Emit(OpCode::kInterpret,
+       static_cast<int32_t>(chunk().fallbacks.size() - 1));
+}
+
+void Compiler::CompileCall(const List& list, bool tail) {
+  Compile(list.front(), false);
+  Expr form{list};
+  chunk().fallbacks.push_back(Fallback{list, CaptureScope(&form)});
+  auto prepare = Emit(OpCode::kPrepareCall,
+                      static_cast<int32_t>(chunk().fallbacks.size() - 1));
+  for (auto it = std::next(list.begin()); it != list.end(); ++it) {
+    Compile(*it, false);
+  }
+  bool tail_call = tail && (!state_->loop || state_->loop->tail);
+  Emit(tail_call ? OpCode::kTailCall : OpCode::kCall,
+       static_cast<int32_t>(list.size() - 1));
+  PatchB(prepare, Here());
+}
+
+}  // namespace vm
+}  // namespace simpl
@@ -0,0 +1,104 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_VM_COMPILER_HH_
+#define SIMPL_VM_COMPILER_HH_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "simpl/ast.hh"
+#include "simpl/interpreter.hh"
+#include "simpl/vm/chunk.hh"
+
+namespace simpl {
+namespace vm {
+
+// Compiles forms into bytecode. Macros are expanded at compile time with the
+// interpreter, so a top-level form should be compiled only after the forms
+// before it have run. Expansions and special forms are guarded by the binding
+// of their head, so that a later redefinition is seen as the interpreter
+// would see it.
+class Compiler {
+ public:
+  explicit Compiler(Interpreter* interpreter) : interpreter_(interpreter) {}
+  std::shared_ptr<Chunk> CompileTopLevel(const Expr& form);
+
+ private:
+  struct Local {
+    const Atom* name;
+    int32_t slot;
+  };
+
+  // Where the recurs in the tail position of a loop body jump to.
+  struct Loop {
+    std::vector<int32_t> slots;
+    int32_t start;
+    // Whether the loop is in the tail position of its function.
+    bool tail;
+  };
+
+  struct FunctionState {
+    FunctionState(FunctionState* enclosing, std::shared_ptr<Chunk> chunk)
+        : enclosing(enclosing), chunk(std::move(chunk)) {}
+    FunctionState* enclosing;
+    std::shared_ptr<Chunk> chunk;
+    std::vector<Local> locals;
+    std::vector<const Atom*> capture_names;
+    int32_t next_slot = 0;
+    // The innermost loop whose body is being compiled.
+    const Loop* loop = nullptr;
+  };
+
+  enum class VarKind { kLocal, kCapture, kGlobal };
+
+  struct Resolved {
+    VarKind kind;
+    int32_t index;
+  };
+
+  Chunk& chunk() { return *state_->chunk; }
+  int32_t Emit(OpCode op, int32_t a = 0, int32_t b = 0);
+  int32_t Here() const;
+  void PatchA(int32_t at, int32_t target);
+  void PatchB(int32_t at, int32_t target);
+  int32_t AddConstant(Expr value);
+  int32_t AddGlobal(const Atom* name);
+  int32_t AddGuard(const Atom* name, callable_ptr_t callable);
+  int32_t DeclareLocal(const Atom* name);
+  int32_t CaptureScope(const Expr* form);
+  bool IsLocal(const Atom* name) const;
+  Resolved Resolve(FunctionState* state, const Atom* name);
+  const Expr* GlobalValue(const Atom* name);
+
+  void Compile(const Expr& expr, bool tail);
+  void CompileSymbol(const Symbol& symbol);
+  void CompileQuoted(const Quoted& quoted, bool tail);
+  void CompileSyntaxQuote(const Expr& expr);
+  void CompileList(const List& list, bool tail);
+  void CompileBody(List::const_iterator begin, List::const_iterator end,
+                   bool tail);
+  void CompileIf(const List& list, bool tail);
+  void CompileLet(const List& list, bool tail);
+  std::vector<int32_t> CompileBindings(const List& list,
+                                       const std::string& form);
+  void CompileLoop(const List& list, bool tail);
+  void CompileRecur(const List& list, bool tail);
+  void CompileFn(List::const_iterator begin, List::const_iterator end,
+                 bool lazy, const Atom* name);
+  void CompileDef(const List& list);
+  void CompileDefn(const List& list);
+  void CompileLogic(const List& list, bool is_and, bool tail);
+  void CompileInterpret(const List& list);
+  void CompileCall(const List& list, bool tail);
+
+  Interpreter* interpreter_;
+  FunctionState* state_ = nullptr;
+};
+
+}  // namespace vm
+}  // namespace simpl
+
+#endif  // SIMPL_VM_COMPILER_HH_
@@ -0,0 +1,57 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_VM_OPCODE_HH_
+#define SIMPL_VM_OPCODE_HH_
+
+#include <cstdint>
+
+namespace simpl {
+namespace vm {
+
+// Operands are described as `a` and `b`, the two immediates of an
+// Instruction. "Push" and "pop" refer to the operand stack of the current
+// frame.
+enum class OpCode : uint8_t {
+  kConst,             // push constants[a]
+  kPop,               // discard the top of the stack
+  kLoadLocal,         // push slot a of the current frame
+  kStoreLocal,        // pop into slot a of the current frame
+  kLoadCapture,       // push captured value a of the current closure
+  kLoadGlobal,        // push the value of globals[a]
+  kDefGlobal,         // pop and bind globals[a], push nil
+  kJump,              // continue at a
+  kJumpIfFalse,       // pop; continue at a if the value is falsy
+  kJumpIfFalseKeep,   // continue at a if the top is falsy, otherwise pop it
+  kJumpIfTrueKeep,    // continue at a if the top is truthy, otherwise pop it
+  kClosure,           // push a closure over functions[a]
+  kPrepareCall,       // if the callee on top does not take evaluated args,
+                      // evaluate fallbacks[a] with it and continue at b
+  kCall,              // call the callee below the top a values
+  kTailCall,          // like kCall, replacing the current frame
+  kReturn,            // return the top of the stack to the caller
+  kGetKeyword,        // pop a map, push its value for the key constants[a]
+  kEval,              // pop a form, push its value evaluated in scopes[a]
+  kInterpret,         // push the value of fallbacks[a]
+  kGuard,             // continue at b unless the global of guards[a] is
+                      // still bound to its callable
+  // A list is built up in reverse, since only its front can grow.
+  kNewList,           // push an empty list
+  kListAppend,        // pop a value and append it to the list on top
+  kListSplice,        // pop a list and append its elements to the list on top
+  kListEnd,           // put the list on top in order
+  // Pop two operands and push the result of a binary built-in, as long as
+  // globals[a] is still bound to the built-in constants[b].
+  kAdd,
+  kSubtract,
+  kMultiply,
+  kEqual,
+  kLess,
+  kLessEqual,
+  kGreater,
+  kGreaterEqual,
+};
+
+}  // namespace vm
+}  // namespace simpl
+
+#endif  // SIMPL_VM_OPCODE_HH_
@@ -0,0 +1,474 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#include "simpl/vm/vm.hh"
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+
+#include "simpl/ast.hh"
+#include "simpl/interpreter_util.hh"
+#include "simpl/memory.hh"
+#include "simpl/stack.hh"
+#include "simpl/vm/compiler.hh"
+
+namespace simpl {
+namespace vm {
+
+namespace {
+
+// Returns the closure in `value` if calling it can be done inside the VM loop.
+Closure* AsStrictClosure(const Expr& value) {
+  const auto* callable = std::get_if<callable_ptr_t>(&value);
+  if (!callable) return nullptr;
+  return (*callable)->kind() == Callable::Kind::kClosure
+             ? static_cast<Closure*>(callable->get())
+             : nullptr;
+}
+
+// Whether `value` is a callable that expects its arguments unevaluated.
+bool TakesForms(const Expr& value) {
+  const auto* callable = std::get_if<callable_ptr_t>(&value);
+  if (!callable) return false;
+  return !(*callable)->is_strict();
+}
+
+template <typename T>
+bool Compare(OpCode op, T lhs, T rhs) {
+  switch (op) {
+    case OpCode::kEqual:
+      return lhs == rhs;
+    case OpCode::kLess:
+      return lhs < rhs;
+    case OpCode::kLessEqual:
+      return lhs <= rhs;
+    case OpCode::kGreater:
+      return lhs > rhs;
+    default:
+      return lhs >= rhs;
+  }
+}
+
+template <typename T>
+Expr Arithmetic(OpCode op, T lhs, T rhs) {
+  switch (op) {
+    case OpCode::kAdd:
+      return Expr{lhs + rhs};
+    case OpCode::kSubtract:
+      return Expr{lhs - rhs};
+    case OpCode::kMultiply:
+      return Expr{lhs * rhs};
+    default:
+      return Expr{Compare(op, lhs, rhs)};
+  }
+}
+
+// Reports the chunk, which the closures of a function form share, to
+// `tracer`: it holds the values of its constants, the forms it leaves to the
+// interpreter, the callables its code was compiled for and the chunks of the
+// functions in it.
+void TraceChunk(const std::shared_ptr<Chunk>& chunk, Tracer& tracer) {
+  tracer.VisitShared(
+      chunk.get(), static_cast<uint32_t>(chunk.use_count()),
+      [](const void* p, Tracer& tracer) {
+        const auto* chunk = static_cast<const Chunk*>(p);
+        for (const auto& value : chunk->constants) {
+          tracer.Visit(value);
+        }
+        for (const auto& fallback : chunk->fallbacks) {
+          fallback.form.Trace(tracer);
+        }
+        for (const auto& guard : chunk->guards) {
+          tracer.Visit(guard.callable);
+        }
+        for (const auto& function : chunk->functions) {
+          TraceChunk(function, tracer);
+        }
+      });
+}
+
+}  // namespace
+
+// Called from outside the VM, such as by a built-in, the interpreter or a
+// lazy function, each of which nests another VM on the native stack.
+Expr Closure::FnCall(Interpreter* interpreter, args_type&& args) {
+  return WithStack([this, interpreter, &args]() {
+    VM vm(interpreter);
+    return vm.Call(this, std::move(args));
+  });
+}
+
+void Closure::Trace(Tracer& tracer) const {
+  for (const auto& value : captures_) {
+    tracer.Visit(value);
+  }
+  TraceChunk(chunk_, tracer);
+}
+
+Expr VM::Run(const std::shared_ptr<Chunk>& chunk) {
+  auto floor = frames_.size();
+  stack_.emplace_back(nullptr);  // no callee for a top-level form
+  auto base = stack_.size();
+  stack_.resize(base + chunk->num_slots, Expr{nullptr});
+  frames_.push_back(Frame{nullptr, chunk.get(), 0, base});
+  return Execute(floor);
+}
+
+Expr VM::Call(Closure* closure, Function::args_type&& args) {
+  auto floor = frames_.size();
+  stack_.emplace_back(nullptr);  // the caller keeps `closure` alive
+  auto base = stack_.size();
+  std::move(args.begin(), args.end(), std::back_inserter(stack_));
+  EnterFrame(closure, base, args.size());
+  return Execute(floor);
+}
+
+// Arguments are at stack_[base, base + argc). Turns them into the parameter
+// slots of a new frame for `closure`.
+void VM::EnterFrame(Closure* closure, size_t base, size_t argc) {
+  Chunk* chunk = closure->chunk();
+  size_t num_params = chunk->num_params;
+  if (argc < num_params) {
+    throw std::runtime_error("Wrong number of arguments to " + chunk->name);
+  }
+  if (chunk->has_rest) {
+    List rest(make_move_iterator(stack_.begin() + base + num_params),
+              make_move_iterator(stack_.end()));
+    stack_.resize(base + num_params);
+    stack_.emplace_back(std::move(rest));
+  } else {
+    stack_.resize(base + num_params);
+  }
+  stack_.resize(base + chunk->num_slots, Expr{nullptr});
+  // Counted last, so that a frame is counted if and only if it is pushed.
+  interpreter_->EnterCall();
+  try {
+    frames_.push_back(Frame{closure, chunk, 0, base});
+  } catch (...) {
+    interpreter_->LeaveCall();
+    throw;
+  }
+}
+
+// Calls anything that is not a strict closure. The callee and its evaluated
+// arguments are popped from the stack.
+Expr VM::CallValue(size_t callee_index, size_t argc) {
+  Function::args_type args(make_move_iterator(stack_.end() - argc),
+                           make_move_iterator(stack_.end()));
+  Expr callee = std::move(stack_[callee_index]);
+  stack_.resize(callee_index);
+  if (auto* callable = std::get_if<callable_ptr_t>(&callee)) {
+    if ((*callable)->kind() != Callable::Kind::kSpecialForm) {
+      return interpreter_->Trampoline(
+          static_cast<Function*>(callable->get())
+              ->CallEvaluated(interpreter_, std::move(args)));
+    }
+    return interpreter_->Trampoline(
+        (*callable)->Call(interpreter_, std::move(args)));
+  }
+  if (holds<Keyword>(callee)) {
+    if (args.size() != 1) {
+      throw std::runtime_error("Keyword expects 1 argument.");
+    }
+    return std::get<Map>(args.front()).at(callee);
+  }
+  throw std::runtime_error("Cannot apply a non-callable");
+}
+
+const Expr& VM::GlobalCell(Chunk* chunk, int32_t index) {
+  auto& global = chunk->globals[index];
+  if (!global.cell) {
+    global.cell = interpreter_->globals()->Find(global.name);
+    if (!global.cell) {
+      throw std::runtime_error("Undefined variable '" + global.name->name + "'");
+    }
+  }
+  return *global.cell;
+}
+
+std::shared_ptr<Interpreter::Environment> VM::Materialize(const Frame& frame,
+                                                          const Scope& scope) {
+  if (scope.empty()) {
+    return interpreter_->globals();
+  }
+  auto env = interpreter_->NewEnvironment(interpreter_->globals());
+  for (const auto& entry : scope) {
+    env->Bind(entry.name, entry.captured
+                              ? frame.closure->captures()[entry.index]
+                              : stack_[frame.base + entry.index]);
+  }
+  return env;
+}
+
+Expr VM::Interpret(const Frame& frame, const Fallback& fallback, Expr callee) {
+  List form = fallback.form;
+  if (!holds<std::nullptr_t>(callee)) {
+    // The head has already been evaluated; don't evaluate it twice.
+    form.pop_front();
+    form.push_front(std::move(callee));
+  }
+  auto env = Materialize(frame, frame.chunk->scopes[fallback.scope]);
+  return interpreter_->Evaluate(ExprList{Expr{std::move(form)}}, env);
+}
+
+bool VM::BinaryOp(OpCode op, const Expr& lhs, const Expr& rhs, Expr* result) {
+  const auto* li = std::get_if<int_type>(&lhs);
+  const auto* ri = std::get_if<int_type>(&rhs);
+  if (li && ri) {
+    *result = Arithmetic(op, *li, *ri);
+    return true;
+  }
+  const auto* lf = std::get_if<float_type>(&lhs);
+  const auto* rf = std::get_if<float_type>(&rhs);
+  if ((li || lf) && (ri || rf)) {
+    *result = Arithmetic(op, li ? static_cast<float_type>(*li) : *lf,
+                         ri ? static_cast<float_type>(*ri) : *rf);
+    return true;
+  }
+  return false;
+}
+
+void VM::PopFrame() {
+  if (frames_.back().closure) {
+    interpreter_->LeaveCall();
+  }
+  frames_.pop_back();
+}
+
+Expr VM::Execute(size_t floor) {
+  try {
+    return Dispatch(floor);
+  } catch (...) {
+    // The frames the exception unwinds are calls that have ended.
+    if (frames_.size() > floor) {
+      stack_.resize(frames_[floor].base - 1);
+    }
+    while (frames_.size() > floor) {
+      PopFrame();
+    }
+    throw;
+  }
+}
+
+Expr VM::Dispatch(size_t floor) {
+  Frame* frame = &frames_.back();
+  for (;;) {
+    const Instruction ins = frame->chunk->code[frame->ip++];
+    switch (ins.op) {
+      case OpCode::kConst:
+        stack_.push_back(frame->chunk->constants[ins.a]);
+        break;
+      case OpCode::kPop:
+        stack_.pop_back();
+        break;
+      case OpCode::kLoadLocal: {
+        Expr value = stack_[frame->base + ins.a];
+        stack_.push_back(std::move(value));
+        break;
+      }
+      case OpCode::kStoreLocal:
+        stack_[frame->base + ins.a] = std::move(stack_.back());
+        stack_.pop_back();
+        break;
+      case OpCode::kLoadCapture:
+        stack_.push_back(frame->closure->captures()[ins.a]);
+        break;
+      case OpCode::kLoadGlobal:
+        stack_.push_back(GlobalCell(frame->chunk, ins.a));
+        break;
+      case OpCode::kDefGlobal: {
+        auto& global = frame->chunk->globals[ins.a];
+        interpreter_->globals()->Define(global.name, std::move(stack_.back()));
+        stack_.back() = Expr{nullptr};
+        break;
+      }
+      case OpCode::kJump:
+        frame->ip = ins.a;
+        break;
+      case OpCode::kJumpIfFalse: {
+        bool truthy = IsTruthy(stack_.back());
+        stack_.pop_back();
+        if (!truthy) frame->ip = ins.a;
+        break;
+      }
+      case OpCode::kJumpIfFalseKeep:
+        if (!IsTruthy(stack_.back())) {
+          frame->ip = ins.a;
+        } else {
+          stack_.pop_back();
+        }
+        break;
+      case OpCode::kJumpIfTrueKeep:
+        if (IsTruthy(stack_.back())) {
+          frame->ip = ins.a;
+        } else {
+          stack_.pop_back();
+        }
+        break;
+      case OpCode::kClosure: {
+        const auto& chunk = frame->chunk->functions[ins.a];
+        AccountedVector<Expr> captures;
+        captures.reserve(chunk->captures.size());
+        for (const auto& capture : chunk->captures) {
+          captures.push_back(capture.from_local
+                                 ? stack_[frame->base + capture.index]
+                                 : frame->closure->captures()[capture.index]);
+        }
+        stack_.emplace_back(
+            std::make_unique<Closure>(chunk, std::move(captures)));
+        break;
+      }
+      case OpCode::kPrepareCall:
+        if (TakesForms(stack_.back())) {
+          Expr callee = std::move(stack_.back());
+          stack_.pop_back();
+          auto result = Interpret(*frame, frame->chunk->fallbacks[ins.a],
+                                  std::move(callee));
+          stack_.push_back(std::move(result));
+          frame->ip = ins.b;
+        }
+        break;
+      case OpCode::kCall: {
+        size_t callee_index = stack_.size() - ins.a - 1;
+        if (auto* closure = AsStrictClosure(stack_[callee_index])) {
+          EnterFrame(closure, callee_index + 1, ins.a);
+          frame = &frames_.back();
+          break;
+        }
+        auto result = CallValue(callee_index, ins.a);
+        stack_.push_back(std::move(result));
+        break;
+      }
+      case OpCode::kTailCall: {
+        size_t callee_index = stack_.size() - ins.a - 1;
+        if (auto* closure = AsStrictClosure(stack_[callee_index])) {
+          // Slide the callee and its arguments down over the current frame.
+          size_t dest = frame->base - 1;
+          std::move(stack_.begin() + callee_index, stack_.end(),
+                    stack_.begin() + dest);
+          stack_.resize(dest + ins.a + 1);
+          PopFrame();
+          EnterFrame(closure, dest + 1, ins.a);
+          frame = &frames_.back();
+          break;
+        }
+        auto result = CallValue(callee_index, ins.a);
+        stack_.push_back(std::move(result));
+      }
+        [[fallthrough]];
+      case OpCode::kReturn: {
+        Expr result = std::move(stack_.back());
+        stack_.resize(frame->base - 1);
+        PopFrame();
+        if (frames_.size() == floor) {
+          return result;
+        }
+        frame = &frames_.back();
+        stack_.push_back(std::move(result));
+        break;
+      }
+      case OpCode::kGetKeyword: {
+        const auto* map = std::get_if<Map>(&stack_.back());
+        if (!map) {
+          throw std::runtime_error("Keyword lookup expects a map.");
+        }
+        stack_.back() = Expr{map->at(frame->chunk->constants[ins.a])};
+        break;
+      }
+      case OpCode::kEval: {
+        Expr form = std::move(stack_.back());
+        stack_.pop_back();
+        auto env = Materialize(*frame, frame->chunk->scopes[ins.a]);
+        auto result = interpreter_->Evaluate(ExprList{std::move(form)}, env);
+        stack_.push_back(std::move(result));
+        break;
+      }
+      case OpCode::kInterpret: {
+        auto result = Interpret(*frame, frame->chunk->fallbacks[ins.a],
+                                Expr{nullptr});
+        stack_.push_back(std::move(result));
+        break;
+      }
+      case OpCode::kGuard: {
+        const auto& guard = frame->chunk->guards[ins.a];
+        const auto* bound = std::get_if<callable_ptr_t>(
+            &GlobalCell(frame->chunk, guard.global));
+        if (!bound || *bound != guard.callable) frame->ip = ins.b;
+        break;
+      }
+      case OpCode::kNewList:
+        stack_.emplace_back(List{});
+        break;
+      case OpCode::kListAppend: {
+        Expr value = std::move(stack_.back());
+        stack_.pop_back();
+        std::get<List>(stack_.back()).push_front(std::move(value));
+        break;
+      }
+      case OpCode::kListSplice: {
+        Expr value = std::move(stack_.back());
+        stack_.pop_back();
+        auto* spliced = std::get_if<List>(&value);
+        if (!spliced) {
+          throw std::runtime_error("~@ expects a list");
+        }
+        auto& list = std::get<List>(stack_.back());
+        for (const auto& e : *spliced) {
+          list.push_front(e);
+        }
+        break;
+      }
+      case OpCode::kListEnd: {
+        List reversed;
+        for (const auto& e : std::get<List>(stack_.back())) {
+          reversed.push_front(e);
+        }
+        stack_.back() = std::move(reversed);
+        break;
+      }
+      case OpCode::kAdd:
+      case OpCode::kSubtract:
+      case OpCode::kMultiply:
+      case OpCode::kEqual:
+      case OpCode::kLess:
+      case OpCode::kLessEqual:
+      case OpCode::kGreater:
+      case OpCode::kGreaterEqual: {
+        const auto& builtin =
+            std::get<callable_ptr_t>(frame->chunk->constants[ins.b]);
+        const Expr& bound = GlobalCell(frame->chunk, ins.a);
+        const auto* current = std::get_if<callable_ptr_t>(&bound);
+        Expr result;
+        if (!current || *current != builtin ||
+            !BinaryOp(ins.op, stack_[stack_.size() - 2], stack_.back(),
+                      &result)) {
+          // Redefined operator or non-numeric operands: make a regular call.
+          stack_.insert(stack_.end() - 2, bound);
+          result = CallValue(stack_.size() - 3, 2);
+        } else {
+          stack_.resize(stack_.size() - 2);
+        }
+        stack_.push_back(std::move(result));
+        break;
+      }
+    }
+  }
+}
+
+Expr Evaluate(Interpreter* interpreter, const ExprList& program) {
+  AccountScope scope(&interpreter->memory());
+  Compiler compiler(interpreter);
+  VM vm(interpreter);
+  Expr result{nullptr};
+  for (const auto& form : program) {
+    result = vm.Run(compiler.CompileTopLevel(form));
+  }
+  return result;
+}
+
+}  // namespace vm
+}  // namespace simpl
@@ -0,0 +1,81 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#ifndef SIMPL_VM_VM_HH_
+#define SIMPL_VM_VM_HH_
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "simpl/ast.hh"
+#include "simpl/function.hh"
+#include "simpl/interpreter.hh"
+#include "simpl/memory.hh"
+#include "simpl/vm/chunk.hh"
+
+namespace simpl {
+namespace vm {
+
+// A function compiled to bytecode, together with the values it captured from
+// the enclosing scopes when it was created.
+class Closure : public Function {
+ public:
+  Closure(std::shared_ptr<Chunk> chunk, AccountedVector<Expr>&& captures)
+      : Function(chunk->lazy ? Kind::kLazyFn : Kind::kClosure),
+        chunk_(std::move(chunk)),
+        captures_(std::move(captures)) {}
+  Chunk* chunk() const { return chunk_.get(); }
+  const AccountedVector<Expr>& captures() const { return captures_; }
+
+ private:
+  Expr FnCall(Interpreter* interpreter, args_type&& args) override;
+  void Trace(Tracer& tracer) const override;
+  std::shared_ptr<Chunk> chunk_;
+  AccountedVector<Expr> captures_;
+};
+
+// Executes chunks. Calls between closures are dispatched inside the same loop
+// on an explicit frame stack; everything else (built-ins, interpreted
+// functions, macros) goes through the interpreter.
+class VM {
+ public:
+  explicit VM(Interpreter* interpreter) : interpreter_(interpreter) {}
+  Expr Run(const std::shared_ptr<Chunk>& chunk);
+  Expr Call(Closure* closure, Function::args_type&& args);
+
+ private:
+  struct Frame {
+    Closure* closure;
+    Chunk* chunk;
+    size_t ip;
+    size_t base;
+  };
+
+  // Runs the frames above `floor` until the lowest of them returns; if an
+  // exception is thrown, they are popped before it is passed on.
+  Expr Execute(size_t floor);
+  Expr Dispatch(size_t floor);
+  // Frames for closures count as calls nested in the interpreter's (see
+  // Interpreter::EnterCall).
+  void EnterFrame(Closure* closure, size_t base, size_t argc);
+  void PopFrame();
+  Expr CallValue(size_t callee_index, size_t argc);
+  const Expr& GlobalCell(Chunk* chunk, int32_t index);
+  std::shared_ptr<Interpreter::Environment> Materialize(const Frame& frame,
+                                                        const Scope& scope);
+  Expr Interpret(const Frame& frame, const Fallback& fallback, Expr callee);
+  bool BinaryOp(OpCode op, const Expr& lhs, const Expr& rhs, Expr* result);
+
+  Interpreter* interpreter_;
+  AccountedVector<Expr> stack_;
+  AccountedVector<Frame> frames_;
+};
+
+// Compiles and runs each form of `program` in turn, returning the value of
+// the last one.
+Expr Evaluate(Interpreter* interpreter, const ExprList& program);
+
+}  // namespace vm
+}  // namespace simpl
+
+#endif  // SIMPL_VM_VM_HH_
@@ -0,0 +1,308 @@
+// Copyright 2023 Hong Jiang <lazyseq@gmail.com> and the contributors
+
+#include "simpl/vm/vm.hh"
+
+#include <gtest/gtest.h>
+
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "simpl/ast.hh"
+#include "simpl/interpreter.hh"
+#include "simpl/interpreter_util.hh"
+#include "simpl/lexer.hh"
+#include "simpl/memory.hh"
+#include "simpl/parser.hh"
+#include "simpl/stack.hh"
+
+namespace simpl {
+namespace vm {
+
+class VMTest : public ::testing::Test {
+ protected:
+  Expr Eval(const std::string& source) {
+    Lexer lexer(source);
+    Parser parser(lexer.scan());
+    return Evaluate(&interpreter_, parser.Parse());
+  }
+  Interpreter interpreter_;
+};
+
+TEST_F(VMTest, Integer) { EXPECT_EQ(std::get<int_type>(Eval("42")), 42); }
+
+TEST_F(VMTest, Arithmetic) {
+  EXPECT_EQ(std::get<int_type>(Eval("(+ 1 2 (* 3 4))")), 15);
+  EXPECT_EQ(std::get<int_type>(Eval("(- 12)")), -12);
+  EXPECT_DOUBLE_EQ(std::get<float_type>(Eval("(+ 1.5 2)")), 3.5);
+  EXPECT_TRUE(std::get<bool>(Eval("(= 1 1.0)")));
+  EXPECT_TRUE(std::get<bool>(Eval("(< \"a\" \"b\")")));
+}
+
+TEST_F(VMTest, InvalidOperands) {
+  EXPECT_THROW(Eval("(+ \"foo\" 32)"), std::runtime_error);
+}
+
+TEST_F(VMTest, RedefinedOperator) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn add [a b] (+ a b))"
+                                    "(def + (fn [a b] (* a b)))"
+                                    "(add 3 4)")),
+            12);
+}
+
+TEST_F(VMTest, Quoted) {
+  auto list = std::get<List>(Eval("'(+ 1 2)"));
+  EXPECT_EQ(list.size(), 3);
+}
+
+TEST_F(VMTest, EmptyListIsNil) {
+  EXPECT_TRUE(holds<std::nullptr_t>(Eval("()")));
+}
+
+TEST_F(VMTest, NestedLet) {
+  EXPECT_EQ(std::get<int_type>(Eval("(let [a 2] (let [a 3] (+ a 4)) a)")), 2);
+  // Values are evaluated in the enclosing scope, as in the interpreter.
+  EXPECT_EQ(std::get<int_type>(Eval("(let [a 1] (let [a 5 b (+ a 1)] b))")),
+            2);
+}
+
+TEST_F(VMTest, IfAndLogic) {
+  EXPECT_EQ(std::get<int_type>(Eval("(if false 3 4)")), 4);
+  EXPECT_TRUE(holds<std::nullptr_t>(Eval("(or false nil ())")));
+  EXPECT_EQ(std::get<int_type>(Eval("(and 1 2 3)")), 3);
+  EXPECT_FALSE(std::get<bool>(Eval("(and true false 3)")));
+  EXPECT_TRUE(std::get<bool>(Eval("(and)")));
+}
+
+TEST_F(VMTest, Closure) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(let [a 5] (def plus (fn [b] (+ a b)))) (plus 2)")),
+            7);
+}
+
+TEST_F(VMTest, NestedClosureCapturesThroughLevels) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn adder [a] (fn [b] (fn [c] "
+                                    "(+ a b c)))) (((adder 1) 2) 3)")),
+            6);
+}
+
+TEST_F(VMTest, Variadic) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn foo [a & b] (head b)) (foo 1 2 3)")),
+            2);
+  EXPECT_TRUE(std::get<bool>(Eval("(defn bar [a & b] (empty? b)) (bar 1)")));
+}
+
+TEST_F(VMTest, Recursion) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn fact [n] (if (= n 0) 1 (* n (fact (- n 1))))) "
+                     "(fact 5)")),
+            120);
+}
+
+TEST_F(VMTest, TailCallsRunInConstantSpace) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn countdown [n] "
+                                    "  (if (= n 0) 0 (countdown (- n 1)))) "
+                                    "(countdown 1000000)")),
+            0);
+}
+
+TEST_F(VMTest, MutualTailCalls) {
+  EXPECT_TRUE(std::get<bool>(
+      Eval("(defn my-even? [n] (if (= n 0) true (my-odd? (- n 1))))"
+           "(defn my-odd? [n] (if (= n 0) false (my-even? (- n 1))))"
+           "(my-even? 100000)")));
+}
+
+TEST_F(VMTest, DeepRecursionDoesNotUseNativeStack) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn sum [n] (if (= n 0) 0 (+ n (sum (- n 1)))))"
+                     "(sum 100000)")),
+            5000050000);
+}
+
+TEST_F(VMTest, LoopRecur) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(defn sum-to [n] (loop [i 0 acc 0] "
+                     "  (if (> i n) acc (recur (+ i 1) (+ acc i))))) "
+                     "(sum-to 1000000)")),
+            500000500000);
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(def fs (loop [i 2 fs ()] "
+                     "  (if (= i 0) fs (recur (- i 1) (cons (fn [] i) fs))))) "
+                     "((head fs))")),
+            1);
+  EXPECT_THROW(Eval("(loop [i 0] (+ 1 (recur 1)))"), std::runtime_error);
+}
+
+TEST_F(VMTest, MaxDepth) {
+  interpreter_.set_max_depth(1000);
+  EXPECT_THROW(Eval("(defn sum [n] (if (= n 0) 0 (+ n (sum (- n 1)))))"
+                    "(sum 2000)"),
+               RecursionDepthError);
+  EXPECT_EQ(std::get<int_type>(Eval("(sum 900)")), 405450);
+}
+
+// Each call through eval or the interpreter runs in a VM of its own, nested
+// on the native stack.
+TEST_F(VMTest, DeepRecursionThroughEval) {
+  EXPECT_EQ(std::get<int_type>(Eval(
+                "(defn g [n] "
+                "  (if (= n 0) 0 (+ 1 (eval (cons 'g (cons (- n 1) '()))))))"
+                "(g 20000)")),
+            20000);
+}
+
+TEST_F(VMTest, DeepRecursionThroughTheInterpreter) {
+  EXPECT_EQ(std::get<int_type>(
+                Eval("(def k 20000)"
+                     "(def down (lazy-fn [a] (do (def k (- k 1)) (h))))"
+                     "(defn h [] (if (= k 0) 0 (+ 1 (down k))))"
+                     "(h)")),
+            20000);
+}
+
+// Calls are counted against one depth, however the engines nest them, and
+// are no longer counted once an exception unwinds them.
+TEST_F(VMTest, MaxDepthAcrossNestedVMs) {
+  Eval("(defn g [n] "
+       "  (if (= n 0) 0 (+ 1 (eval (cons 'g (cons (- n 1) '()))))))");
+  interpreter_.set_max_depth(1000);
+  EXPECT_THROW(Eval("(g 1000)"), RecursionDepthError);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_THROW(Eval("(g 1000)"), RecursionDepthError);
+  }
+  EXPECT_EQ(std::get<int_type>(Eval("(g 400)")), 400);
+}
+
+TEST_F(VMTest, MemoryLimitOnDeepRecursion) {
+  auto& memory = interpreter_.memory();
+  Eval("(defn sum [n] (if (= n 0) 0 (+ n (sum (- n 1)))))");
+  memory.set_limit(8 * 1024 * 1024);
+  EXPECT_THROW(Eval("(sum 200000)"), MemoryLimitError);
+  EXPECT_EQ(std::get<int_type>(Eval("(sum 100)")), 5050);
+}
+
+TEST_F(VMTest, KeywordLookup) {
+  EXPECT_EQ(std::get<int_type>(Eval("(let [m {:a 1 :b 2}] (:b m))")), 2);
+}
+
+TEST_F(VMTest, LazyFn) {
+  EXPECT_EQ(2, std::get<int_type>(Eval("(let [f (lazy-fn [a] (eval (head a)))] "
+                                       "(f ((/ 2 1) (/ 2 0))))")));
+}
+
+TEST_F(VMTest, EvalSeesLexicalScope) {
+  EXPECT_EQ(std::get<int_type>(Eval("(let [a 1] ((fn [] (eval '(+ a 2)))))")),
+            3);
+}
+
+TEST_F(VMTest, Macros) {
+  EXPECT_EQ(std::get<int_type>(Eval(
+                "(defmacro when [cond & body] `(if ~cond (do ~@body) nil))"
+                "(defn f [x] (when (> x 0) (* x 2)))"
+                "(f 21)")),
+            42);
+}
+
+TEST_F(VMTest, MacroDefinedAfterUse) {
+  EXPECT_EQ(std::get<int_type>(Eval(
+                "(defn f [x] (twice x))"
+                "(defmacro twice [e] `(+ ~e ~e))"
+                "(f 21)")),
+            42);
+}
+
+TEST_F(VMTest, RedefinedMacro) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defmacro twice [e] `(+ ~e ~e))"
+                                    "(defn f [x] (twice x))"
+                                    "(f 21)"
+                                    "(defmacro twice [e] `(* ~e 2 2))"
+                                    "(f 21)")),
+            84);
+}
+
+TEST_F(VMTest, RedefinedSpecialForm) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn f [x] (if x 1 2))"
+                                    "(def if (fn [c a b] 3))"
+                                    "(f true)")),
+            3);
+}
+
+TEST_F(VMTest, SyntaxQuote) {
+  auto list = std::get<List>(Eval("(let [x 2 ys '(3 4)] `(a ~x ~@ys))"));
+  EXPECT_EQ(list.size(), 4);
+  EXPECT_EQ(std::get<int_type>(list.back()), 4);
+}
+
+TEST_F(VMTest, InterpreterCallsClosures) {
+  EXPECT_EQ(std::get<int_type>(Eval("(defn inc [x] (+ x 1))"
+                                    "(eval '(inc 41))")),
+            42);
+}
+
+TEST_F(VMTest, UndefinedVariable) {
+  EXPECT_THROW(Eval("(+ 1 nope)"), std::runtime_error);
+}
+
+TEST_F(VMTest, NonCallable) { EXPECT_THROW(Eval("(1 2)"), std::runtime_error); }
+
+// Runs each program with the interpreter and with the VM, each with an
+// interpreter of its own, and expects the same result or an error from both.
+// The chunk of `f` holds the macro it was compiled for, a closure over the
+// globals that hold `f`.
+TEST(VMMemoryTest, GlobalsFreedWithTheInterpreter) {
+  auto interpreter = std::make_unique<Interpreter>();
+  Lexer lexer(
+      "(defmacro when [cond & body] `(if ~cond (do ~@body) nil))"
+      "(defn f [x] (when (> x 0) (* x 2)))"
+      "(f 21)");
+  Parser parser(lexer.scan());
+  Evaluate(interpreter.get(), parser.Parse());
+  std::weak_ptr<Interpreter::Environment> globals = interpreter->globals();
+  interpreter = nullptr;
+  EXPECT_TRUE(globals.expired());
+}
+
+TEST(DifferentialTest, VMAgreesWithTheInterpreter) {
+  const char* programs[] = {
+      "(let [a 1] (let [a 2 b a] b))",
+      "(let [a 1 a (+ a 1)] a)",
+      "(let [x 1] (loop [x 10 y x] (if (> x 12) y (recur (+ x 1) x))))",
+      "(defmacro m [] 1) (defn f [] (m)) (f) (defmacro m [] 2) (f)",
+      "(defmacro m [x] `(+ ~x 1)) (defn f [] (m 1)) (def m (fn [x] x)) (f)",
+      "(defn f [x] (let [y x] (if y 1 2))) (def let (fn [& xs] 7)) (f 1)",
+      "(defn f [n acc] (if (= n 0) acc (f (- n 1) (+ acc n)))) (f 1000 0)",
+      "(def xs (loop [i 3 fs ()] (if (= i 0) fs (recur (- i 1) "
+      "  (cons (fn [] i) fs))))) (map (fn [f] (f)) xs)",
+      "(let [a 1 b (+ a 1)] b)",
+      "(and 1 nil 2) (or nil false)",
+      "`(1 ~(+ 1 1) ~@(list 3 4))",
+      "(defn f [& xs] xs) (f 1 2 3)",
+      "((fn [a] (eval '(+ a 1))) 2)",
+      "(defn f [x] x) (f)",
+      "(defn f [x y] (if (= x 0) y (f (- x 1)))) (f 3 0)",
+      "(defn f [x] x) (f 1 2)",
+  };
+  for (const char* program : programs) {
+    SCOPED_TRACE(program);
+    auto run = [program](bool vm) -> std::string {
+      Interpreter interpreter;
+      Lexer lexer(program);
+      Parser parser(lexer.scan());
+      std::ostringstream out;
+      try {
+        out << (vm ? Evaluate(&interpreter, parser.Parse())
+                   : interpreter.Evaluate(parser.Parse()));
+      } catch (const std::exception&) {
+        out << "<error>";
+      }
+      return out.str();
+    };
+    EXPECT_EQ(run(true), run(false));
+  }
+}
+
+}  // namespace vm
+}  // namespace simpl